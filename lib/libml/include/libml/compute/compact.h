@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "libml/compute/nodes.h"
+
+namespace ml {
+
+enum class OpCode : uint8_t {
+  Constant,
+  Identity,
+  Mult,
+  Divide,
+  Sub,
+  UnarySub,
+  Add,
+  ReLU,
+  Sigmoid,
+  Sine,
+  CtePower,
+  Power,
+  Exp,
+  Ln,
+  Abs,
+  Invert,
+  Avg,
+  Step,
+};
+
+// Record of a compiled node: its operation and where its inputs are listed.
+// Values and adjoints are kept apart, in arrays indexed like the records.
+struct CompactNode {
+  uint32_t firstInput;
+  uint32_t nbInputs;
+  OpCode opcode;
+};
+static_assert(sizeof(CompactNode) <= 12, "CompactNode must fit in 12 bytes");
+
+// Flat copy of every node reachable from a set of outputs, in topological
+// order. Records and input offsets live in contiguous arrays, ids and source
+// nodes are kept in cold side arrays only used for lookups.
+// Clones share the records, and share the values and adjoints until the first
+// write to them. Clones keep no pointer to the source nodes: label() and
+// sourceId() read the cold arrays, pull() is only available on the original,
+// which must not outlive the graph it was compiled from.
+class CompactGraph {
+public:
+  explicit CompactGraph(
+      const std::vector<std::reference_wrapper<ComputeNode>> &outputs);
+  int nbNodes() const;
+  const CompactNode &nodeAt(int index) const;
+  int inputAt(int index, int slot) const;
+  int indexOf(ComputeNode &node) const;
+  double value(int index) const;
+  void setValue(int index, double value);
+  double adjoint(int index) const;
+  std::string label(int index) const;
+  uint32_t sourceId(int index) const;
+  void pull();
+  void forward();
+  void backward();
+  CompactGraph clone() const;
+  bool sharesRecordsWith(const CompactGraph &other) const;
+  bool sharesValuesWith(const CompactGraph &other) const;
+
+private:
+  // Records of the same opcode and arity at the same depth never depend on
+  // each other, forward() evaluates each pack a few lanes at a time
+  struct Pack {
+    OpCode opcode;
+    uint32_t nbInputs;
+    uint32_t first;
+    uint32_t size;
+  };
+  // Immutable once compiled, shared by every clone
+  struct Topology {
+    std::vector<CompactNode> nodes;
+    std::vector<uint32_t> inputs;
+    std::vector<uint32_t> outputs;
+    std::vector<Pack> packs;
+    std::vector<uint32_t> packed;
+    // Cold side arrays
+    std::vector<uint32_t> ids;
+    std::unordered_map<ComputeNode *, uint32_t> indices;
+  };
+  // Per clone, copied by the first write of a clone that shares it
+  struct State {
+    std::vector<double> values;
+    std::vector<double> adjoints;
+  };
+  std::shared_ptr<const Topology> _topology;
+  std::shared_ptr<State> _state;
+  // Empty in clones
+  std::vector<ComputeNode *> _sources;
+  std::vector<double> _scratch;
+
+  CompactGraph() = default;
+  State &_own();
+};
+
+} // namespace ml
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "libml/compute/graph.h"
+#include "libml/compute/nodes.h"
+
+namespace ml {
+
+// Backward pass of an output built as new nodes of the same graph.
+// gradient(i) computes d output / d wrt[i] from the local partials of every
+// node multiplied by its upstream adjoint. The result is a plain forward
+// graph: it can be evaluated, compiled or differentiated again by another
+// SymbolicGradient. Its nodes are skipped by ComputeNode::diff(), which stays
+// the derivative of the forward outputs only.
+class SymbolicGradient final : public ComputeSubGraph {
+public:
+  SymbolicGradient(
+      IComputeGraph &graph, ComputeNode &output,
+      const std::vector<std::reference_wrapper<ComputeNode>> &wrt);
+  ComputeNode &gradient(int index) const;
+  int size() const;
+
+private:
+  std::vector<ComputeNode *> _gradients;
+};
+
+} // namespace ml
@@ -1,8 +1,11 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <set>
+#include <span>
+#include <unordered_map>
 #include <vector>
 
 #include "libml/compute/nodes.h"
@@ -17,6 +20,9 @@ struct ComputeEdge {
   bool operator<(const ComputeEdge &e) const;
 };
 
+class ComputeGraph;
+class ComputeSubGraph;
+
 class IComputeGraph {
 public:
   IComputeGraph() = default;
@@ -31,19 +37,29 @@ public:
   virtual NodeFactory &nodeFactory() = 0;
   virtual void registerNode(std::unique_ptr<ComputeNode> node) = 0;
   virtual uint32_t newId() = 0;
-  virtual std::vector<std::reference_wrapper<ComputeNode>> getInputsNodes() = 0;
-  virtual std::vector<std::reference_wrapper<ComputeNode>> getOutputNodes() = 0;
+  // Views valid until the graph structure changes
+  virtual std::span<const std::reference_wrapper<ComputeNode>>
+  getInputsNodes() = 0;
+  virtual std::span<const std::reference_wrapper<ComputeNode>>
+  getOutputNodes() = 0;
+  virtual ComputeGraph &rootGraph() = 0;
   //  Not copyable
   IComputeGraph &operator=(const IComputeGraph &) = delete;
   IComputeGraph(const IComputeGraph &) = delete;
 };
 
+// Owns every node and edge. Subgraphs are views: each node and edge is only
+// tagged with the innermost subgraph it was created through, a subgraph
+// holds what is tagged with it or with one of its nested subgraphs.
 class ComputeGraph final : public IComputeGraph {
 public:
   ComputeGraph();
   ~ComputeGraph() override;
   ComputeEdge createEdge(ComputeNode &src, ComputeNode &dst,
                          const std::optional<int> &slot) override;
+  ComputeEdge createEdge(ComputeNode &src, ComputeNode &dst,
+                         const std::optional<int> &slot,
+                         ComputeSubGraph *owner);
   void removeEdge(ComputeEdge &edge) override;
   std::vector<ComputeEdge> &getEdges() override;
   void removeNode(ComputeNode &node) override;
@@ -51,20 +67,55 @@ public:
   int nbNodes() const override;
   NodeFactory &nodeFactory() override;
   void registerNode(std::unique_ptr<ComputeNode> node) override;
-  virtual std::vector<std::reference_wrapper<ComputeNode>>
+  void registerNode(std::unique_ptr<ComputeNode> node, ComputeSubGraph *owner);
+  std::span<const std::reference_wrapper<ComputeNode>>
   getInputsNodes() override;
-  virtual std::vector<std::reference_wrapper<ComputeNode>>
+  std::span<const std::reference_wrapper<ComputeNode>>
   getOutputNodes() override;
+  ComputeGraph &rootGraph() override;
+  ComputeSubGraph *ownerOf(ComputeNode &node);
+  ComputeSubGraph *edgeOwner(int index);
+  bool isWithin(ComputeSubGraph *owner, const ComputeSubGraph &graph) const;
+  // Bumped on every structural change, subgraph views compare against it
+  uint64_t version() const;
+  // Renumber the live nodes densely, in registration order
+  void compact();
+  int nbFreeIds() const;
   //  Not copyable
   ComputeGraph &operator=(const ComputeGraph &) = delete;
   ComputeGraph(const ComputeGraph &) = delete;
   uint32_t newId() override;
 
 private:
-  std::vector<ComputeNode *> _nodes;
+  // Registration order, removed nodes are left null until the next pack
+  mutable std::vector<ComputeNode *> _nodes;
+  mutable int _nbRemoved = 0;
   std::vector<ComputeEdge> _edges;
+  // Null for the base graph
+  std::vector<ComputeSubGraph *> _edgeOwners;
+  // Indexed by node id
+  std::vector<ComputeSubGraph *> _owners;
+  mutable std::vector<int> _positions;
+  // Removed nodes, deleted once their edges are dropped
+  std::vector<ComputeNode *> _removed;
+  // Destroyed subgraphs and their parent: the edges they created between
+  // nodes of other subgraphs are handed to the parent with the next drop
+  std::unordered_map<ComputeSubGraph *, ComputeSubGraph *> _destroyed;
+  uint64_t _version = 0;
+  // Nodes without inputs and without outputs, refreshed on version changes
+  std::vector<std::reference_wrapper<ComputeNode>> _inputNodes;
+  std::vector<std::reference_wrapper<ComputeNode>> _outputNodes;
+  uint64_t _endsVersion = UINT64_MAX;
   NodeFactory _nodeFactory;
   uint32_t _nextId = 0;
+  // Ids of removed nodes, handed out again before new ones
+  std::vector<uint32_t> _freeIds;
+
+  void _packNodes() const;
+  // Deletes the removed nodes with their edges and retags the edges of the
+  // destroyed subgraphs, before anything reads or writes the tags
+  void _dropRemoved();
+  friend class ComputeSubGraph;
 };
 
 class ComputeSubGraph : public IComputeGraph {
@@ -81,20 +132,84 @@ public:
   NodeFactory &nodeFactory() override;
   void registerNode(std::unique_ptr<ComputeNode> node) override;
   IComputeGraph &baseGraph() const;
-  virtual std::vector<std::reference_wrapper<ComputeNode>>
+  std::span<const std::reference_wrapper<ComputeNode>>
   getInputsNodes() override;
-  virtual std::vector<std::reference_wrapper<ComputeNode>>
+  std::span<const std::reference_wrapper<ComputeNode>>
   getOutputNodes() override;
+  ComputeGraph &rootGraph() override;
+  ComputeSubGraph *parentSubGraph() const;
   //  Not copyable
   ComputeSubGraph &operator=(const ComputeSubGraph &) = delete;
   ComputeSubGraph(const ComputeSubGraph &) = delete;
   uint32_t newId() override;
 
 private:
+  friend class ComputeGraph;
   IComputeGraph &_graph;
+  ComputeGraph &_root;
+  ComputeSubGraph *_parent;
   NodeFactory _nodeFactory;
-  std::vector<ComputeNode *> _nodes;
-  std::vector<ComputeEdge> _edges;
+  // Nodes registered directly through this subgraph, removed with it
+  std::vector<ComputeNode *> _ownNodes;
+  // Only filled when the view is read, in registration order, from the tags
+  // of the root graph and refreshed on version changes
+  mutable std::vector<ComputeNode *> _viewNodes;
+  mutable std::vector<ComputeEdge> _viewEdges;
+  mutable std::vector<std::reference_wrapper<ComputeNode>> _inputNodes;
+  mutable std::vector<std::reference_wrapper<ComputeNode>> _outputNodes;
+  mutable uint64_t _viewVersion = UINT64_MAX;
+
+  void _forget(ComputeNode &node);
+  void _updateView() const;
 };
 
+// Nodes and edges created by construction tasks running on a worker thread.
+// Registrations are recorded instead of touching the shared graphs and are
+// replayed on the calling thread once every task is done.
+class NodeBlock {
+public:
+  NodeBlock() = default;
+  static NodeBlock *active();
+  // Always UINT32_MAX: the final ids are only given by merge(), reading the
+  // id of a deferred node before asserts
+  uint32_t deferId();
+  void deferNode(IComputeGraph &graph, std::unique_ptr<ComputeNode> node);
+  // An auto slot is resolved here, after the inputs dst already has and the
+  // ones deferred to it by this block
+  ComputeEdge deferEdge(IComputeGraph &graph, ComputeNode &src,
+                        ComputeNode &dst, const std::optional<int> &slot);
+  // Closes the registrations of the current task
+  void endTask();
+  // Replays the registrations of one task
+  void merge(int task);
+
+private:
+  struct Registration {
+    IComputeGraph *graph;
+    std::unique_ptr<ComputeNode> node;
+    ComputeNode *src;
+    ComputeNode *dst;
+    int slot;
+  };
+  std::vector<Registration> _registrations;
+  // End of the registrations of each task
+  std::vector<int> _taskEnds;
+  // Next auto slot of the nodes this block added inputs to
+  std::unordered_map<ComputeNode *, int> _nextSlots;
+};
+
+// Run task(i, j) for every cell of a grid of nbRows x nbColumns. Each column
+// runs on one worker thread, in row order, and records into its own
+// NodeBlock. The blocks are merged row by row, so ids, slots and edges come
+// out exactly as with the loops for (i) for (j) task(i, j). Tasks of
+// different columns must not add auto slot inputs to the same node.
+// An exception thrown by a task is rethrown here once the workers are done.
+void buildGridInParallel(int nbRows, int nbColumns,
+                         const std::function<void(int, int)> &task);
+// A grid of one row: task(0) ... task(nbTasks - 1)
+void buildInParallel(int nbTasks, const std::function<void(int)> &task);
+// Worker threads of the parallel builds, 0 for one per hardware thread.
+// Builds with less than two workers run the loops on the calling thread.
+void setBuildThreads(int nbThreads);
+
 } // namespace ml
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+
+namespace ml {
+
+// Instruction sets of the dense kernels, the best one the cpu supports is
+// picked at startup
+enum class SimdLevel { Scalar, SSE2, AVX2, AVX512 };
+
+SimdLevel simdLevel();
+bool isSupported(SimdLevel level);
+// Mainly to compare the variants, the level must be supported
+void setSimdLevel(SimdLevel level);
+const char *simdLevelName(SimdLevel level);
+
+// Row-major kernels on doubles, a is m x n
+// y = a * x + bias, bias may be null
+void gemv(int m, int n, const double *a, const double *x, const double *bias,
+          double *y);
+// y = a^T * x
+void gemvTransposed(int m, int n, const double *a, const double *x,
+                    double *y);
+// a = x * y^T
+void outerProduct(int m, int n, const double *x, const double *y, double *a);
+// c = a * b^T + bias, with a m x k, b n x k, c m x n and bias may be null
+void gemm(int m, int n, int k, const double *a, const double *b,
+          const double *bias, double *c);
+
+// Sparse matrices in slices of SPARSE_SLICE rows (sliced ELLPACK): the rows
+// of a slice are padded with zeros to the longest one, then interleaved.
+// Entry p of row t of slice s is at offsets[s] + p * SPARSE_SLICE + t.
+constexpr int SPARSE_SLICE = 8;
+// y = a * x + bias for a sparse a with m rows, bias may be null
+void sparseGemv(int m, const int *offsets, const int *columns,
+                const double *values, const double *x, const double *bias,
+                double *y);
+
+// s = sin(x) and c = cos(x) element-wise, s or c may be null.
+// Polynomial after a reduction modulo 2pi, within ~1e-13 of std::sin up to
+// a few hundreds: not meant for huge arguments.
+void sinCos(int n, const double *x, double *s, double *c);
+
+// Integer kernels of the quantized models, on values within [-127, 127].
+// The int32 sums are exact.
+// Bytes of a m x n matrix packed for gemvInt8
+int packedInt8Size(int m, int n);
+// Row-major a to the layout of gemvInt8: for each pair of inputs, the two
+// weights of every output next to each other
+void packInt8(int m, int n, const int8_t *a, int8_t *packed);
+// y = a * x with a packed by packInt8 and x held in int16
+void gemvInt8(int m, int n, const int8_t *packed, const int16_t *x,
+              int32_t *y);
+
+// 16-bit floats, widened to float in registers: IEEE half precision, or the
+// high half of a float (bfloat16) for the range of a float with less
+// precision. Rounded to the nearest even.
+enum class HalfFormat { FP16, BF16 };
+uint16_t toHalf(HalfFormat format, float x);
+float fromHalf(HalfFormat format, uint16_t h);
+void toHalf(HalfFormat format, int n, const float *x, uint16_t *h);
+void fromHalf(HalfFormat format, int n, const uint16_t *h, float *x);
+// y = a^T * x + bias with a and x in half, summed in float. bias may be
+// null.
+void gemvHalfTransposed(HalfFormat format, int m, int n, const uint16_t *a,
+                        const uint16_t *x, const float *bias, float *y);
+
+} // namespace ml
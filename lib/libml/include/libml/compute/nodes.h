@@ -1,8 +1,8 @@
 #pragma once
 
 #include <cstdint>
-#include <map>
 #include <optional>
+#include <ranges>
 #include <string>
 #include <vector>
 
@@ -19,12 +19,28 @@ public:
   void erase(ComputeNode &node);
   void erase(int index);
   int size() const;
-  std::vector<ComputeNode *> getNodes();
-  std::vector<int> getIndices();
+  bool contains(int index) const;
+  // Lazy views over the connected slots
+  auto getNodes() const {
+    return _inputs | std::views::filter([](ComputeNode *n) { return n; });
+  }
+  auto getIndices() const {
+    return std::views::iota(0, size()) |
+           std::views::filter([this](const int i) { return _inputs[i]; });
+  }
 
 private:
-  std::map<ComputeNode *, int> _inputIndices = {};
-  std::map<int, ComputeNode *> _inputs = {};
+  // Indexed by slot, erased slots are left null
+  std::vector<ComputeNode *> _inputs;
+  void _trim();
+};
+
+// Interned strings shared by every graph, node labels only keep a handle
+class LabelTable {
+public:
+  static uint32_t intern(const std::string &label);
+  static const std::string &get(uint32_t handle);
+  static constexpr uint32_t EMPTY = 0;
 };
 
 class ComputeNodeVisitor;
@@ -36,6 +52,9 @@ public:
   virtual std::string label() = 0;
   virtual double pdiff(int index) = 0;
   double eval();
+  // Hard precondition: every node depending on this one was evaluated since
+  // the last invalidation. Partials are read from the values cached by that
+  // forward pass and are not checked in release builds.
   double diff();
   void invalidateCache();
   int connect(ComputeNode &other, const std::optional<int> &slot = {});
@@ -45,13 +64,11 @@ public:
   void clearConnections();
   ComputeNode &inputAt(int index);
   ComputeNode &outputAt(int index) const;
+  bool hasInput(int index) const;
   int nbInputs() const;
   int nbOutputs() const;
 
-  int incOwnerCount();
-  int decOwnerCount();
-  int ownerCount();
-
+  // Nodes built inside a NodeBlock only get their id once it is merged
   uint32_t id();
 
   virtual void forwardVisit(ComputeNodeVisitor &v) = 0;
@@ -59,16 +76,31 @@ public:
 
 protected:
   ComputeNode() = default;
+  // Value of the last forward pass, only valid once eval() ran
+  double cachedEval() const;
 
 private:
-  std::optional<double> _cachedEval = {};
-  std::optional<double> _cachedGradient = {};
+  friend class ComputeGraph;
+  friend class NodeBlock;
+  friend class SymbolicGradient;
+  struct Output {
+    ComputeNode *node;
+    int slot;
+  };
+  enum Flags : uint8_t {
+    HAS_EVAL = 1 << 0,
+    HAS_GRADIENT = 1 << 1,
+    INVALIDATE_CACHE = 1 << 2,
+    // Built by a SymbolicGradient, kept when the cache is cleared
+    SYMBOLIC = 1 << 3,
+  };
+  double _cachedEval = 0.0;
+  double _cachedGradient = 0.0;
   Slots _slots;
-  std::vector<ComputeNode *> _outputs;
+  std::vector<Output> _outputs;
   virtual double _eval() = 0;
-  bool _invalidateCache = false;
   void _clearCache();
-  int _ownerCount = 0;
+  uint8_t _flags = 0;
   uint32_t _id;
 };
 
@@ -98,8 +130,8 @@ public:
 
 private:
   double _value;
-  std::string _label;
-  std::string _labelPrefix;
+  uint32_t _label = LabelTable::EMPTY;
+  uint32_t _labelPrefix = LabelTable::EMPTY;
   double _eval() override;
 };
 
@@ -113,6 +145,8 @@ public:
 
 private:
   double _eval() override;
+  // Gathered operands, followed by their partials once they are needed
+  std::vector<double> _operands;
 };
 
 class CteMultNode final : public ComputeNode {
@@ -140,6 +174,8 @@ public:
 
 private:
   double _eval() override;
+  // Operands of the last forward pass, pdiff reads them
+  double _operands[2] = {};
 };
 
 class CteDivideNode final : public ComputeNode {
@@ -217,6 +253,22 @@ private:
   double _eval() override;
 };
 
+// sin(omega * x), omega is the frequency factor of SIREN
+class SineNode final : public ComputeNode {
+public:
+  explicit SineNode(uint32_t id, double omega);
+  std::string label() override;
+  double getOmega() const;
+  double pdiff(int index) override;
+  void forwardVisit(ComputeNodeVisitor &v) override;
+  void backwardVisit(ComputeNodeVisitor &v) override;
+
+private:
+  double _eval() override;
+  double _omega;
+  double _cosine = 1.0;
+};
+
 class CtePowerNode final : public ComputeNode {
 public:
   std::string label() override;
@@ -230,6 +282,7 @@ public:
 private:
   int _power;
   double _eval() override;
+  double _operand = 0.0;
 };
 
 class PowerNode final : public ComputeNode {
@@ -242,6 +295,7 @@ public:
 
 private:
   double _eval() override;
+  double _operands[2] = {};
 };
 
 class ExpNode final : public ComputeNode {
@@ -266,6 +320,7 @@ public:
 
 private:
   double _eval() override;
+  double _operand = 0.0;
 };
 
 class AbsNode final : public ComputeNode {
@@ -278,6 +333,7 @@ public:
 
 private:
   double _eval() override;
+  double _operand = 0.0;
 };
 
 class InvertNode final : public ComputeNode {
@@ -304,6 +360,18 @@ private:
   double _eval() override;
 };
 
+class StepNode final : public ComputeNode {
+public:
+  explicit StepNode(uint32_t id);
+  std::string label() override;
+  double pdiff(int index) override;
+  void forwardVisit(ComputeNodeVisitor &v) override;
+  void backwardVisit(ComputeNodeVisitor &v) override;
+
+private:
+  double _eval() override;
+};
+
 class IComputeGraph;
 
 class NodeFactory {
@@ -319,6 +387,7 @@ public:
   AddNode &createAddNode() const;
   ReLUNode &createReLUNode() const;
   SigmoidNode &createSigmoidNode() const;
+  SineNode &createSineNode(double omega) const;
   CtePowerNode &createCtePowerNode(int power) const;
   PowerNode &createPowerNode() const;
   ExpNode &createExpNode() const;
@@ -328,6 +397,7 @@ public:
   AbsNode &createAbsNode() const;
   AvgNode &createAvgNode() const;
   InvertNode &createInvertNode() const;
+  StepNode &createStepNode() const;
 
 private:
   IComputeGraph &_graph;
@@ -344,6 +414,7 @@ public:
   virtual bool visit(AddNode &n) = 0;
   virtual bool visit(ReLUNode &n) = 0;
   virtual bool visit(SigmoidNode &n) = 0;
+  virtual bool visit(SineNode &n) = 0;
   virtual bool visit(CtePowerNode &n) = 0;
   virtual bool visit(PowerNode &n) = 0;
   virtual bool visit(ExpNode &n) = 0;
@@ -353,6 +424,7 @@ public:
   virtual bool visit(AbsNode &n) = 0;
   virtual bool visit(AvgNode &n) = 0;
   virtual bool visit(InvertNode &n) = 0;
+  virtual bool visit(StepNode &n) = 0;
   virtual ~ComputeNodeVisitor() = default;
 
 protected:
@@ -0,0 +1,11 @@
+#pragma once
+
+namespace ml {
+
+// Reductions over a contiguous buffer of gathered node inputs
+double reduceSum(const double *values, int n);
+double reduceProduct(const double *values, int n);
+// partials[i] = product of every value except values[i]
+void reduceProductPartials(const double *values, int n, double *partials);
+
+} // namespace ml
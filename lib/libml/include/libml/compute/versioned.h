@@ -0,0 +1,115 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace ml {
+
+// Versions of an immutable value: readers pin the published version without
+// ever taking a lock, a writer publishes the next one with a single atomic
+// swap. Replaced versions are reclaimed by epoch once no reader pinned
+// before the swap is still active.
+template <class T> class Versioned {
+public:
+  static constexpr int MAX_READERS = 64;
+
+  // Pinned version, keep it short lived: it delays reclamation
+  class Snapshot {
+  public:
+    Snapshot(Snapshot &&other) noexcept
+        : _slot(std::exchange(other._slot, nullptr)), _value(other._value) {}
+    Snapshot &operator=(Snapshot &&) = delete;
+    ~Snapshot() {
+      if (_slot)
+        _slot->store(IDLE, std::memory_order_release);
+    }
+    const T *get() const { return _value; }
+    const T &operator*() const { return *_value; }
+    const T *operator->() const { return _value; }
+    explicit operator bool() const { return _value != nullptr; }
+
+  private:
+    friend class Versioned;
+    Snapshot(std::atomic<uint64_t> *slot, const T *value)
+        : _slot(slot), _value(value) {}
+    std::atomic<uint64_t> *_slot;
+    const T *_value;
+  };
+
+  Versioned() = default;
+  explicit Versioned(std::unique_ptr<T> initial)
+      : _current(initial.release()) {}
+  ~Versioned() {
+    for (const ReaderSlot &r : _readers)
+      assert(r.epoch.load() == IDLE && "Version still pinned by a reader");
+    delete _current.load();
+  }
+  //  Not copyable
+  Versioned &operator=(const Versioned &) = delete;
+  Versioned(const Versioned &) = delete;
+
+  Snapshot read() const {
+    // Claim a free slot, announce the epoch, then load the version: a writer
+    // swapping after the announcement cannot reclaim what is loaded here
+    for (;;) {
+      for (ReaderSlot &r : _readers) {
+        uint64_t expected = IDLE;
+        const uint64_t epoch = _epoch.load();
+        if (r.epoch.compare_exchange_strong(expected, epoch))
+          return {&r.epoch, _current.load()};
+      }
+    }
+  }
+
+  void publish(std::unique_ptr<T> next) {
+    std::lock_guard lock(_writeMutex);
+    T *old = _current.exchange(next.release());
+    const uint64_t epoch = _epoch.fetch_add(1);
+    if (old)
+      _retired.emplace_back(epoch, std::unique_ptr<T>(old));
+    _reclaim();
+  }
+
+  // Frees what the readers released since the last publish
+  void reclaim() {
+    std::lock_guard lock(_writeMutex);
+    _reclaim();
+  }
+
+  int nbRetired() const {
+    std::lock_guard lock(_writeMutex);
+    return static_cast<int>(_retired.size());
+  }
+
+private:
+  static constexpr uint64_t IDLE = 0;
+  struct alignas(64) ReaderSlot {
+    std::atomic<uint64_t> epoch = IDLE;
+  };
+
+  std::atomic<T *> _current = nullptr;
+  std::atomic<uint64_t> _epoch = 1;
+  mutable std::array<ReaderSlot, MAX_READERS> _readers;
+  mutable std::mutex _writeMutex;
+  std::vector<std::pair<uint64_t, std::unique_ptr<T>>> _retired;
+
+  void _reclaim() {
+    // A version retired at epoch e is only reachable by readers pinned at
+    // an epoch <= e
+    uint64_t oldest = UINT64_MAX;
+    for (const ReaderSlot &r : _readers) {
+      const uint64_t e = r.epoch.load();
+      if (e != IDLE && e < oldest)
+        oldest = e;
+    }
+    std::erase_if(_retired, [&](const auto &r) { return r.first < oldest; });
+  }
+};
+
+} // namespace ml
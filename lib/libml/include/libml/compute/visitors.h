@@ -19,6 +19,7 @@ public:
   bool visit(AddNode &n);
   bool visit(ReLUNode &n);
   bool visit(SigmoidNode &n);
+  bool visit(SineNode &n);
   bool visit(CtePowerNode &n);
   bool visit(PowerNode &n);
   bool visit(ExpNode &n);
@@ -28,6 +29,7 @@ public:
   bool visit(AbsNode &n);
   bool visit(AvgNode &n);
   bool visit(InvertNode &n);
+  bool visit(StepNode &n);
   ~GraphvizVisitor();
   GraphvizVisitor();
 
@@ -34,6 +34,16 @@ private:
   ComputeNode &_sigmoid;
 };
 
+class SineActivation final : public Activation {
+public:
+  explicit SineActivation(IComputeGraph &graph, double omega);
+  void setInput(ComputeNode &node) override;
+  ComputeNode &output() override;
+
+private:
+  ComputeNode &_sine;
+};
+
 class IdentityActivation final : public Activation {
 public:
   explicit IdentityActivation(IComputeGraph &graph);
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "libml/neural/layers.h"
+
+namespace ml {
+
+// Fully connected layer stored as a row-major weight matrix and a bias
+// vector, evaluated with the matrix kernels instead of scalar nodes.
+// A layer without inputs takes one value per neuron, like the input layer
+// of a graph MLP.
+class DenseLayer {
+public:
+  DenseLayer(int nbInputs, int size, LayerBuilder::Type type, bool bias);
+  int size() const;
+  int nbInputs() const;
+  bool hasBias() const;
+  LayerBuilder::Type type() const;
+  // Same order as a graph layer: for each neuron its bias, then its inputs
+  int nbWeights() const;
+  double getWeight(int index) const;
+  void setWeight(double value, int index);
+  double getWeightDiff(int index) const;
+  // Single sample, the result is kept for the backward pass
+  void forward(const double *input);
+  const double *output() const;
+  // Row-major batch of samples, nothing is kept
+  void forwardBatch(const double *inputs, int batch, double *outputs) const;
+  // Gradients of the last forward pass, inputDiff may be null
+  void backward(const double *input, const double *outputDiff,
+                double *inputDiff);
+
+private:
+  int _nbInputs;
+  int _size;
+  LayerBuilder::Type _type;
+  bool _bias;
+  std::vector<double> _weights;
+  std::vector<double> _biases;
+  std::vector<double> _weightDiffs;
+  std::vector<double> _biasDiffs;
+  std::vector<double> _output;
+  std::vector<double> _delta;
+  // cos(omega x) of the last forward pass, derivative of the sine
+  std::vector<double> _cosines;
+
+  void _activate(double *values, int n, double *cosines) const;
+  double _activationDiff(double output) const;
+  // Row and column of a weight in the matrix, column -1 for a bias
+  std::pair<int, int> _locate(int index) const;
+};
+
+} // namespace ml
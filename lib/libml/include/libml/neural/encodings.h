@@ -0,0 +1,103 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "libml/neural/dataset.h"
+
+namespace ml {
+
+// Maps the dataset inputs to the inputs of an MLP, its parameters are
+// trained from the input gradients of the MLP.
+// encode() doesn't modify anything, a copy can evaluate on another thread.
+class Encoding {
+public:
+  virtual ~Encoding() = default;
+  virtual int nbInputs() const = 0;
+  virtual int nbOutputs() const = 0;
+  virtual void encode(const double *input, double *output) const = 0;
+  // Training on a dataset starts, its encoded samples may be cached
+  virtual void setDataSet(const DataSet &dataSet);
+  // Sample of the dataset, from the cache when it is the one of setDataSet()
+  virtual void encodeSample(const DataSet &dataSet, int index,
+                            double *output) const;
+  // Gradient step for one sample from the gradients of its outputs
+  virtual void backward(const double *input, const double *outputDiff) = 0;
+  virtual std::unique_ptr<Encoding> clone() const = 0;
+  // Standalone C++ for an exported model: its constants, prefixed by
+  // ENCODING_, and an encode(float x, float y, float *output) function
+  virtual void writeSource(std::ostream &out) const = 0;
+};
+
+// Multi-resolution hash grid over 2D coordinates in [0, 1]: each level is a
+// grid of trainable feature vectors, the coarse levels are stored directly
+// and the finer ones share a table through a spatial hash. The features of
+// the 4 grid points around a coordinate are interpolated bilinearly, the
+// outputs are the features of each level one after the other.
+// A step only updates the 4 entries per level the sample touched.
+class HashGridEncoding final : public Encoding {
+public:
+  double learningRate;
+  explicit HashGridEncoding(int nbLevels = 8, int nbFeatures = 2,
+                            int log2TableSize = 14, int baseResolution = 4,
+                            int maxResolution = 256,
+                            double learningRate = 0.1);
+  int nbInputs() const override;
+  int nbOutputs() const override;
+  int nbLevels() const;
+  int nbFeatures() const;
+  int tableSize() const;
+  int resolution(int level) const;
+  int nbParameters() const;
+  void encode(const double *input, double *output) const override;
+  void backward(const double *input, const double *outputDiff) override;
+  std::unique_ptr<Encoding> clone() const override;
+  void writeSource(std::ostream &out) const override;
+
+private:
+  int _nbLevels;
+  int _nbFeatures;
+  int _tableSize;
+  std::vector<int> _resolutions;
+  // Level after level, one feature vector per entry
+  std::vector<double> _table;
+
+  // Entries of the 4 surrounding grid points and their weights
+  void _corners(const double *input, int level, std::array<int, 4> &entries,
+                std::array<double, 4> &weights) const;
+};
+
+// sin and cos of 2pi f.x for a set of frequency vectors f, after the
+// coordinates themselves when they are kept. The bands are either powers of
+// two along each axis or drawn from a gaussian of deviation scale.
+// Nothing is trained, the encoded samples of the dataset are computed once.
+class FourierEncoding final : public Encoding {
+public:
+  enum class Bands { LogSpaced, Gaussian };
+  explicit FourierEncoding(int nbFrequencies = 6,
+                           Bands bands = Bands::LogSpaced, double scale = 10.0,
+                           bool keepInputs = true);
+  int nbInputs() const override;
+  int nbOutputs() const override;
+  void encode(const double *input, double *output) const override;
+  void setDataSet(const DataSet &dataSet) override;
+  void encodeSample(const DataSet &dataSet, int index,
+                    double *output) const override;
+  void backward(const double *input, const double *outputDiff) override;
+  std::unique_ptr<Encoding> clone() const override;
+  void writeSource(std::ostream &out) const override;
+
+private:
+  bool _keepInputs;
+  // x and y of each frequency vector
+  std::vector<double> _frequencies;
+  const DataSet *_cachedDataSet = nullptr;
+  std::vector<double> _cache;
+
+  // Rows of 2 coordinates to rows of outputs
+  void _encodeRows(const double *inputs, int nbRows, double *outputs) const;
+};
+
+} // namespace ml
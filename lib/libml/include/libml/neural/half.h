@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "libml/compute/kernels.h"
+#include "libml/neural/inference.h"
+
+namespace ml {
+
+// 16-bit copy of an InferenceModel, for inference only: half the memory of a
+// float model, a quarter of the double one. The weights and the values
+// passed between layers are stored in half, the kernels widen them to float
+// in registers. The biases and the activations stay in float.
+// Nothing is modified by an evaluation, a model can be shared by threads.
+class HalfMLP {
+public:
+  HalfMLP(const InferenceModel &model, HalfFormat format);
+  // From the output of MLP::exportWeights(), without the mlp itself
+  HalfMLP(const std::vector<LayerBuilder> &topology, HalfFormat format,
+          const std::vector<uint16_t> &weights);
+  // Coordinates per sample, before the encoding
+  int nbInputs() const;
+  int nbOutputs() const;
+  HalfFormat format() const;
+  // Bytes of the weights and the biases
+  int nbBytes() const;
+  // Row-major batch, like InferenceModel::evaluate()
+  void evaluate(std::span<const float> coords, std::span<float> rgb) const;
+
+private:
+  struct Layer {
+    int nbInputs;
+    int size;
+    LayerBuilder::Type type;
+    // Transposed, size values per input
+    std::vector<uint16_t> weights;
+    std::vector<float> biases;
+  };
+  HalfFormat _format;
+  std::shared_ptr<const Encoding> _encoding;
+  int _nbInputs;
+  InferenceLayer _first;
+  // From the second layer
+  std::vector<Layer> _layers;
+};
+
+} // namespace ml
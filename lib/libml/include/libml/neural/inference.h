@@ -0,0 +1,65 @@
+#pragma once
+
+#include <memory>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "libml/neural/encodings.h"
+#include "libml/neural/layers.h"
+
+namespace ml {
+
+// Dense layer of a trained MLP, what the inference models are built from
+struct InferenceLayer {
+  int nbInputs;
+  int size;
+  LayerBuilder::Type type;
+  // Row-major, nbInputs values per neuron
+  std::vector<double> weights;
+  std::vector<double> biases;
+};
+
+// Activation of a layer on n values, in place
+void activate(LayerBuilder::Type type, double *values, int n);
+
+// Values of the first layer for nbInputs coordinates, before its activation:
+// the coordinates through the encoding when there is one, plus the biases
+void inputValues(const Encoding *encoding, const InferenceLayer &first,
+                 int nbInputs, const float *coords, double *values);
+
+// Trained MLP reduced to its layer descriptors and weights, see
+// MLP::freeze(): no compute graph, no gradient, nothing of the training.
+// The coordinates go through a copy of the input encoding when there is one.
+// Immutable, any number of threads can evaluate the same model at once.
+class InferenceModel {
+public:
+  // weights: in the order of MLP::getWeight()
+  InferenceModel(const std::vector<LayerBuilder> &topology,
+                 const std::vector<double> &weights,
+                 const Encoding *encoding = nullptr);
+  // Coordinates per sample, before the encoding
+  int nbInputs() const;
+  int nbOutputs() const;
+  // Row-major batch: nbInputs() coordinates per sample in, nbOutputs()
+  // values per sample out
+  void evaluate(std::span<const float> coords, std::span<float> rgb) const;
+  // Standalone C++ header of the model in namespace name: constexpr float
+  // weights and an eval(float x, float y, float rgb[3]) written for this
+  // exact topology, only the standard library is needed to build it
+  void writeSource(std::ostream &out, const std::string &name = "model") const;
+  // False when the file couldn't be written
+  bool saveSource(const std::string &path,
+                  const std::string &name = "model") const;
+  // The first layer only has biases
+  const std::vector<InferenceLayer> &layers() const;
+  // Null without an encoding
+  const std::shared_ptr<const Encoding> &encoding() const;
+
+private:
+  std::vector<InferenceLayer> _layers;
+  std::shared_ptr<const Encoding> _encoding;
+};
+
+} // namespace ml
@@ -11,44 +11,89 @@ namespace ml {
 class Layer : public ComputeSubGraph {
 public:
   ~Layer() override;
-  void connectToLayer(const Layer &other) const;
+  // fromInputLayer: this is the input layer of the network
+  void connectToLayer(const Layer &other, bool fromInputLayer = false) const;
   void addInput(ComputeNode &node) const;
+  // Removes the weighted inputs of every neuron from index first on
+  void removeInputs(int first) const;
   Neuron &getNeuron(int index) const;
   int size() const;
   void addNeuron(Neuron *n);
+  // New neurons only get their bias, the last ones are removed first
+  void resize(int size);
+  // The weights are numbered neuron after neuron. Every neuron of a layer
+  // has the same inputs, so a weight is found from its index directly.
   ComputeNode &getWeight(int index) const;
   int nbWeights() const;
+  // Index of the first weight in the MLP, the layer owns a contiguous range
+  int firstWeight() const;
 
 protected:
   explicit Layer(IComputeGraph &graph);
+  // SIREN initialization of the weights coming into this layer
+  virtual bool sirenInit() const;
+  virtual Neuron *createNeuron() = 0;
+  void addNeurons(int size);
+  void addBiasInput();
 
 private:
+  friend class MLP;
   std::vector<Neuron *> _neurons;
+  ConstantNode *_bias = nullptr;
+  int _firstWeight = 0;
 };
 
 class LayerReLU final : public Layer {
 public:
   explicit LayerReLU(IComputeGraph &graph, int size, bool addBias = true);
+
+protected:
+  Neuron *createNeuron() override;
 };
 
 class LayerSigmoid final : public Layer {
 public:
   explicit LayerSigmoid(IComputeGraph &graph, int size, bool addBias = true);
+
+protected:
+  Neuron *createNeuron() override;
+};
+
+class LayerSine final : public Layer {
+public:
+  explicit LayerSine(IComputeGraph &graph, int size, bool addBias = true);
+
+protected:
+  bool sirenInit() const override;
+  Neuron *createNeuron() override;
 };
 
 class LayerIdentity final : public Layer {
 public:
   explicit LayerIdentity(IComputeGraph &graph, int size, bool addBias = true);
+
+protected:
+  Neuron *createNeuron() override;
 };
 
 class LayerBuilder {
 public:
-  enum class Type { ReLu, Sigmoid, Identity };
+  enum class Type { ReLu, Sigmoid, Identity, Sine };
+  // Graph layers are made of nodes, dense layers of weight matrices
+  enum class Backend { Graph, Dense };
   int size = 0;
   Type type = Type::Identity;
   bool bias = false;
+  Backend backend = Backend::Graph;
   LayerBuilder() = default;
-  explicit LayerBuilder(int size, Type type, bool addBias);
+  explicit LayerBuilder(int size, Type type, bool addBias,
+                        Backend backend = Backend::Graph);
   std::unique_ptr<Layer> build(IComputeGraph &graph);
 };
+// Frequency factor of the sine activations, the omega_0 of SIREN
+constexpr double SINE_OMEGA = 30.0;
+// Weight of a connection into a sine layer from nbInputs neurons, uniform
+// with a range that keeps the pre-activations within a few periods
+double sirenWeight(int nbInputs, bool fromInputLayer);
+
 } // namespace ml
\ No newline at end of file
@@ -1,34 +1,103 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
 #include <vector>
 
 #include "libml/compute/graph.h"
+#include "libml/compute/kernels.h"
+#include "libml/neural/dense.h"
+#include "libml/neural/encodings.h"
+#include "libml/neural/inference.h"
 #include "libml/neural/layers.h"
 #include "libml/neural/losses.h"
 
 namespace ml {
 
+// With dense layers, the input and output nodes are constants set around
+// the matrix products: eval() must run before evaluating what uses them.
 class MLP final : public ComputeSubGraph {
 public:
   explicit MLP(IComputeGraph &graph, const std::vector<LayerBuilder> &layers);
   ~MLP() override;
   int nbInputs() const;
   int nbOutputs() const;
+  ComputeNode &getInputNode(int index) const;
   ComputeNode &getOutputNode(int index) const;
   int nbWeights() const;
+  // Graph backend only
+  ComputeNode &getWeightNode(int index) const;
   void setInput(double value, int index) const;
   void setWeight(double value, int index) const;
   double getOutput(int index) const;
   double getWeight(int index) const;
   double getWeightDiff(int index) const;
+  // Gradient of an input after diff()
+  double getInputDiff(int index) const;
   void eval() const;
+  // Evaluates the network first, nodes added after its outputs (a loss)
+  // must have been evaluated by the caller
   void diff() const;
+  const std::vector<LayerBuilder> &topology() const;
+  // Copy of the current weights for inference only, encoding may be null
+  InferenceModel freeze(const Encoding *encoding = nullptr) const;
+  // All the weights in the order of getWeight(), rounded to 16 bits
+  std::vector<uint16_t> exportWeights(HalfFormat format) const;
+  void importWeights(HalfFormat format,
+                     const std::vector<uint16_t> &weights) const;
+
+  // ARCHITECTURE EDITS
+  // In place, on hidden layers only: the layers around the edited one are
+  // reconnected, the others keep their weights and their nodes. Each edit
+  // returns the previous index of every weight, -1 for the new ones, for
+  // the optimizer state (see Optimizer::remapWeights()).
+  // A new layer starts as the identity of its inputs when its activation
+  // allows it, new neurons start with no effect on the next layer. The layer
+  // after a removed one keeps its biases, its inputs are drawn again.
+  std::vector<int> insertLayer(int index, const LayerBuilder &layer);
+  std::vector<int> removeLayer(int index);
+  std::vector<int> resizeLayer(int index, int size);
+  std::vector<int> setActivation(int index, LayerBuilder::Type type);
+
+  // PRUNING
+  // Only the connections between neurons are pruned, not the biases. A
+  // pruned weight is set to 0 and masked: setWeight() leaves it at 0, so
+  // training afterwards only fine-tunes the others. The mask follows the
+  // architecture edits. Both return the number of pruned weights.
+  int prune(double threshold);
+  // The smallest connections until sparsity of them are pruned
+  int pruneToSparsity(double sparsity);
+  bool isPruned(int index) const;
+  int nbPruned() const;
+  int nbConnections() const;
+  // The pruned weights can grow back, they start at 0
+  void clearPruning();
 
 private:
+  std::vector<LayerBuilder> _builders;
+  // Indexed like the weights, empty when nothing is pruned
+  std::vector<bool> _pruned;
   std::vector<Layer *> _layers;
   std::vector<ComputeNode *> _inputs;
   std::vector<ComputeNode *> _outputs;
   std::vector<ComputeNode *> _weights;
+  void _collectWeights();
+  // Layer l of the new topology comes from the old layer origins[l], -1 for
+  // a new one
+  std::vector<int> _edit(const std::vector<LayerBuilder> &layers,
+                         const std::vector<int> &origins);
+
+  // DENSE BACKEND
+  std::vector<std::unique_ptr<DenseLayer>> _denseLayers;
+  std::vector<int> _denseOffsets;
+  void _updateDenseOffsets();
+  mutable bool _denseDirty = true;
+  mutable std::vector<double> _denseInputDiffs;
+  std::vector<double> _denseInputs() const;
+  std::pair<DenseLayer *, int> _denseWeight(int index) const;
+  void _buildDense(const std::vector<LayerBuilder> &layers);
+  void _evalDense() const;
+  void _diffDense() const;
 };
 
 } // namespace ml
\ No newline at end of file
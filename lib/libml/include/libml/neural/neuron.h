@@ -13,6 +13,8 @@ public:
   ComputeNode &output() const;
   void addInput(ComputeNode &node, bool addWeight, double weight);
   void connectToNeuron(Neuron &other, double weight) const;
+  // Removes the weighted inputs from index first to the last one
+  void removeInputs(int first);
   ComputeNode &getWeight(int index) const;
   int nbWeights() const;
 
@@ -23,6 +25,8 @@ protected:
 
 private:
   std::vector<ComputeNode *> _inputWeights;
+  // Product of each weight with its input
+  std::vector<ComputeNode *> _inputMults;
 };
 
 class NeuronReLu final : public Neuron {
@@ -40,4 +44,9 @@ public:
   explicit NeuronSigmoid(IComputeGraph &graph);
 };
 
+class NeuronSine final : public Neuron {
+public:
+  explicit NeuronSine(IComputeGraph &graph, double omega);
+};
+
 } // namespace ml
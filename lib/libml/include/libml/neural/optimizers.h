@@ -1,10 +1,13 @@
 #pragma once
 
+#include "libml/compute/compact.h"
 #include "libml/neural/dataset.h"
+#include "libml/neural/encodings.h"
 #include "libml/neural/losses.h"
 #include "libml/neural/mlp.h"
 
 #include <memory>
+#include <optional>
 #include <random>
 #include <vector>
 
@@ -25,18 +28,41 @@ class Optimizer : public ComputeSubGraph {
 public:
   virtual bool optimize() = 0;
   virtual void setDataset(DataSet &dataSet);
+  // The dataset inputs go through the encoding before the mlp, it is trained
+  // with its own learning rate. May be null, must outlive the optimizer.
+  void setEncoding(Encoding *encoding);
+  // The mlp architecture was edited, origins gives the previous index of
+  // each weight (-1 for a new one), see MLP::insertLayer()
+  virtual void remapWeights(const std::vector<int> &origins) = 0;
   Loss &getLoss();
 
 protected:
   explicit Optimizer(MLP &mlp, std::unique_ptr<Loss> loss);
   void _forward();
-  void _backward() const;
+  void _backward();
+  // Gradient of a weight after _backward()
+  double _weightDiff(int index) const;
   virtual int nextTrainingIndex() = 0;
   void setLoss(std::unique_ptr<Loss> loss);
   MLP &_mlp;
   DataSet *_dataSet = nullptr;
   std::unique_ptr<Loss> _loss;
   std::vector<ComputeNode *> _trueValues;
+  Encoding *_encoding = nullptr;
+  std::vector<double> _encodingInput;
+  std::vector<double> _encodingOutput;
+
+private:
+  // Graph backend: the mlp and the loss compiled together, recompiled when
+  // the graph structure changes. Empty with dense layers.
+  std::optional<CompactGraph> _compiled;
+  uint64_t _compiledVersion = UINT64_MAX;
+  int _lossIndex = -1;
+  // Records of the weights and of the mlp inputs, -1 when not compiled
+  std::vector<int> _weightIndices;
+  std::vector<int> _inputIndices;
+  bool _compile();
+  double _inputDiff(int index) const;
 };
 
 class BatchOptimizer final : public Optimizer {
@@ -46,6 +72,7 @@ public:
   explicit BatchOptimizer(MLP &mlp, std::unique_ptr<Loss> loss,
                           double learningRate = 0.01, double momentum = 0.0);
   bool optimize() override;
+  void remapWeights(const std::vector<int> &origins) override;
 
 protected:
   int nextTrainingIndex() override;
@@ -66,6 +93,7 @@ public:
                         bool nesterov = false);
   bool optimize() override;
   void setDataset(DataSet &dataSet) override;
+  void remapWeights(const std::vector<int> &origins) override;
 
 protected:
   int nextTrainingIndex() override;
@@ -74,6 +102,7 @@ private:
   int _currentInput = 0;
 
   std::vector<double> _previousUpdate;
+  std::vector<double> _gradient;
   std::vector<int> _indices;
 
   std::random_device _randomDevice;
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "libml/neural/dataset.h"
+#include "libml/neural/inference.h"
+
+namespace ml {
+
+// Int8 copy of an InferenceModel, for inference only. For each layer, the
+// weights and the inputs are scaled to [-127, 127] and multiplied with the
+// integer kernels. The int32 sums are scaled back before the bias and the
+// activation.
+// The input scale of each layer is the largest value it gets over samples of
+// a calibration dataset: larger values at inference time are clamped.
+// Nothing is modified by an evaluation, a model can be shared by threads.
+class QuantizedMLP {
+public:
+  // At most nbSamples of the dataset are evaluated, spread over it, through
+  // the encoding of the model
+  QuantizedMLP(const InferenceModel &model, const DataSet &dataSet,
+               int nbSamples = 4096);
+  // Coordinates per sample, before the encoding
+  int nbInputs() const;
+  int nbOutputs() const;
+  // Bytes of the int8 weights
+  int nbBytes() const;
+  // Row-major batch, like InferenceModel::evaluate()
+  void evaluate(std::span<const float> coords, std::span<float> rgb) const;
+
+private:
+  struct Layer {
+    int nbInputs;
+    int size;
+    LayerBuilder::Type type;
+    // Packed for gemvInt8
+    std::vector<int8_t> weights;
+    std::vector<double> biases;
+    double weightScale;
+    double inputScale;
+  };
+  std::shared_ptr<const Encoding> _encoding;
+  int _nbInputs;
+  InferenceLayer _first;
+  // From the second layer
+  std::vector<Layer> _layers;
+};
+
+} // namespace ml
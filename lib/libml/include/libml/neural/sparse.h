@@ -0,0 +1,47 @@
+#pragma once
+
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "libml/neural/inference.h"
+
+namespace ml {
+
+// Copy of an InferenceModel without its zero weights, for inference only: meant
+// for pruned models (see MLP::prune()), each layer only multiplies its
+// remaining connections. Stored in slices for sparseGemv().
+// Nothing is modified by an evaluation, a model can be shared by threads.
+class SparseMLP {
+public:
+  explicit SparseMLP(const InferenceModel &model);
+  // Coordinates per sample, before the encoding
+  int nbInputs() const;
+  int nbOutputs() const;
+  // Connections kept, the biases left out
+  int nbNonZeros() const;
+  // Bytes of the values, their columns and the biases, with the padding of
+  // the slices
+  int nbBytes() const;
+  // Row-major batch, like InferenceModel::evaluate()
+  void evaluate(std::span<const float> coords, std::span<float> rgb) const;
+
+private:
+  struct Layer {
+    int nbInputs;
+    int size;
+    LayerBuilder::Type type;
+    int nbNonZeros;
+    std::vector<int> offsets;
+    std::vector<int> columns;
+    std::vector<double> values;
+    std::vector<double> biases;
+  };
+  std::shared_ptr<const Encoding> _encoding;
+  int _nbInputs;
+  InferenceLayer _first;
+  // From the second layer
+  std::vector<Layer> _layers;
+};
+
+} // namespace ml
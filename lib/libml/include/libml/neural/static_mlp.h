@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#include "libml/compute/kernels.h"
+#include "libml/neural/dataset.h"
+#include "libml/neural/layers.h"
+#include "libml/neural/mlp.h"
+
+namespace ml {
+
+// MLP with a topology fixed at compile time, same layers as the application
+// builds them: an identity input layer, hidden layers of activation Act with
+// a bias, then an identity output layer without bias.
+// Weights are in the same order as an MLP of that topology (see layers()).
+// The optimizers only train an MLP: train one, then copy its weights here
+// with loadWeights(). forward() and backward() are for inference and for
+// gradients outside of an optimizer.
+// Nothing is allocated, every loop bound is a constant.
+template <LayerBuilder::Type Act, int... Sizes> class StaticMLP {
+  static_assert(sizeof...(Sizes) >= 2, "Needs an input and an output layer");
+
+  static constexpr int NB_LAYERS = sizeof...(Sizes);
+  static constexpr std::array<int, NB_LAYERS> SIZES{Sizes...};
+
+  static constexpr bool hasBias(const int layer) {
+    return layer > 0 && layer < NB_LAYERS - 1;
+  }
+  // MLP order, per neuron of a layer: its bias then one weight per input
+  static constexpr int rowSize(const int layer) {
+    return SIZES[layer - 1] + (hasBias(layer) ? 1 : 0);
+  }
+  static constexpr int weightOffset(const int layer) {
+    int offset = 0;
+    for (int l = 1; l < layer; ++l)
+      offset += SIZES[l] * rowSize(l);
+    return offset;
+  }
+  static constexpr int unitOffset(const int layer) {
+    int offset = 0;
+    for (int l = 0; l < layer; ++l)
+      offset += SIZES[l];
+    return offset;
+  }
+
+public:
+  static constexpr int NB_INPUTS = SIZES.front();
+  static constexpr int NB_OUTPUTS = SIZES.back();
+  static constexpr int NB_WEIGHTS = weightOffset(NB_LAYERS);
+  using Input = std::array<double, NB_INPUTS>;
+  using Output = std::array<double, NB_OUTPUTS>;
+
+  // Same topology as an MLP
+  static std::vector<LayerBuilder>
+  layers(const LayerBuilder::Backend backend = LayerBuilder::Backend::Graph) {
+    std::vector<LayerBuilder> builders;
+    for (int l = 0; l < NB_LAYERS; ++l)
+      builders.emplace_back(SIZES[l],
+                            hasBias(l) ? Act : LayerBuilder::Type::Identity,
+                            hasBias(l), backend);
+    return builders;
+  }
+
+  void loadWeights(const MLP &mlp) {
+    assert(mlp.nbWeights() == NB_WEIGHTS && "ERROR: different topology");
+    for (int i = 0; i < NB_WEIGHTS; ++i)
+      setWeight(mlp.getWeight(i), i);
+  }
+  void storeWeights(const MLP &mlp) const {
+    assert(mlp.nbWeights() == NB_WEIGHTS && "ERROR: different topology");
+    for (int i = 0; i < NB_WEIGHTS; ++i)
+      mlp.setWeight(getWeight(i), i);
+  }
+
+  double getWeight(const int index) const { return _weights[index]; }
+  void setWeight(const double value, const int index) {
+    _weights[index] = value;
+  }
+  double getWeightDiff(const int index) const { return _weightDiffs[index]; }
+
+  const Output &forward(const Input &input) {
+    for (int i = 0; i < NB_INPUTS; ++i)
+      _units[i] = input[i];
+    _forward<1>();
+    for (int i = 0; i < NB_OUTPUTS; ++i)
+      _output[i] = _units[unitOffset(NB_LAYERS - 1) + i];
+    return _output;
+  }
+  const Output &forward(const DataSet &dataSet, const int index) {
+    Input input;
+    for (int i = 0; i < NB_INPUTS; ++i)
+      input[i] = dataSet.inputTable().get(index, i);
+    return forward(input);
+  }
+
+  // Gradients of the last forward pass, returns the input gradients
+  const Input &backward(const Output &outputDiff) {
+    for (int i = 0; i < NB_OUTPUTS; ++i)
+      _deltas[unitOffset(NB_LAYERS - 1) + i] = outputDiff[i];
+    _backward<NB_LAYERS - 1>();
+    for (int i = 0; i < NB_INPUTS; ++i)
+      _inputDiff[i] = _deltas[i];
+    return _inputDiff;
+  }
+
+private:
+  static constexpr int NB_UNITS = unitOffset(NB_LAYERS);
+
+  std::array<double, NB_WEIGHTS> _weights{};
+  std::array<double, NB_WEIGHTS> _weightDiffs{};
+  // Outputs and gradients of every neuron, layer after layer
+  std::array<double, NB_UNITS> _units{};
+  std::array<double, NB_UNITS> _deltas{};
+  Output _output{};
+  Input _inputDiff{};
+  // Derivatives of the sine activations, cos(omega x)
+  std::array<double, Act == LayerBuilder::Type::Sine ? NB_UNITS : 0> _cosines{};
+
+  static double _activate(const double x) {
+    if constexpr (Act == LayerBuilder::Type::ReLu)
+      return std::max(0.0, x);
+    else if constexpr (Act == LayerBuilder::Type::Sigmoid)
+      return 1.0 / (1 + std::exp(-x));
+    else if constexpr (Act == LayerBuilder::Type::Sine)
+      return SINE_OMEGA * x; // sin() is taken for the whole layer
+    else
+      return x;
+  }
+  static double _activationDiff(const double output) {
+    if constexpr (Act == LayerBuilder::Type::ReLu)
+      return output > 0.0 ? 1.0 : 0.0;
+    else if constexpr (Act == LayerBuilder::Type::Sigmoid)
+      return output * (1.0 - output);
+    else
+      return 1.0;
+  }
+
+  template <int L> void _forward() {
+    if constexpr (L < NB_LAYERS) {
+      constexpr int IN = SIZES[L - 1], OUT = SIZES[L];
+      constexpr int BIAS = hasBias(L) ? 1 : 0;
+      // Two partial sums per neuron halve the dependency chain of the adds
+      constexpr int SPLIT = IN % 2 == 0 ? 2 : 1;
+      const double *x = _units.data() + unitOffset(L - 1);
+      double *y = _units.data() + unitOffset(L);
+      for (int j = 0; j < OUT; ++j) {
+        const double *row = _weights.data() + weightOffset(L) + j * (IN + BIAS);
+        std::array<double, SPLIT> s{};
+        for (int i = 0; i < IN; i += SPLIT)
+          for (int k = 0; k < SPLIT; ++k)
+            s[k] += row[BIAS + i + k] * x[i + k];
+        double sum = BIAS ? row[0] : 0.0;
+        for (int k = 0; k < SPLIT; ++k)
+          sum += s[k];
+        y[j] = BIAS ? _activate(sum) : sum;
+      }
+      // The sines of a layer in one call of the vectorized kernel
+      if constexpr (BIAS && Act == LayerBuilder::Type::Sine)
+        sinCos(OUT, y, y, _cosines.data() + unitOffset(L));
+      _forward<L + 1>();
+    }
+  }
+
+  template <int L> void _backward() {
+    if constexpr (L > 0) {
+      constexpr int IN = SIZES[L - 1], OUT = SIZES[L];
+      constexpr int BIAS = hasBias(L) ? 1 : 0;
+      const double *x = _units.data() + unitOffset(L - 1);
+      const double *y = _units.data() + unitOffset(L);
+      double *delta = _deltas.data() + unitOffset(L);
+      double *inputDelta = _deltas.data() + unitOffset(L - 1);
+      for (int i = 0; i < IN; ++i)
+        inputDelta[i] = 0.0;
+      for (int j = 0; j < OUT; ++j) {
+        const int row = weightOffset(L) + j * (IN + BIAS);
+        const double *w = _weights.data() + row;
+        double *dw = _weightDiffs.data() + row;
+        if constexpr (BIAS && Act == LayerBuilder::Type::Sine) {
+          delta[j] *= SINE_OMEGA * _cosines[unitOffset(L) + j];
+          dw[0] = delta[j];
+        } else if constexpr (BIAS) {
+          delta[j] *= _activationDiff(y[j]);
+          dw[0] = delta[j];
+        }
+        for (int i = 0; i < IN; ++i) {
+          dw[BIAS + i] = x[i] * delta[j];
+          inputDelta[i] += w[BIAS + i] * delta[j];
+        }
+      }
+      _backward<L - 1>();
+    }
+  }
+};
+
+} // namespace ml
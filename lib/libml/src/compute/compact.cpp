@@ -0,0 +1,457 @@
+#include "libml/compute/compact.h"
+#include "libml/compute/kernels.h"
+#include "libml/compute/reduce.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <map>
+#include <tuple>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace ml {
+
+namespace {
+// Single dispatch on the node type, the traversal itself is done by
+// CompactGraph so every visit stops right away
+class OpCodeVisitor final : public ComputeNodeVisitor {
+public:
+  OpCode opcode = OpCode::Constant;
+  // Constant operand of the Cte* nodes, appended as an extra input
+  std::optional<double> operand;
+
+  bool visit(IdentityNode &n) override { return set(OpCode::Identity); }
+  bool visit(ConstantNode &n) override { return set(OpCode::Constant); }
+  bool visit(MultNode &n) override { return set(OpCode::Mult); }
+  bool visit(DivideNode &n) override { return set(OpCode::Divide); }
+  bool visit(UnarySubNode &n) override { return set(OpCode::UnarySub); }
+  bool visit(SubNode &n) override { return set(OpCode::Sub); }
+  bool visit(AddNode &n) override { return set(OpCode::Add); }
+  bool visit(ReLUNode &n) override { return set(OpCode::ReLU); }
+  bool visit(SigmoidNode &n) override { return set(OpCode::Sigmoid); }
+  bool visit(SineNode &n) override {
+    return set(OpCode::Sine, n.getOmega());
+  }
+  bool visit(CtePowerNode &n) override {
+    return set(OpCode::CtePower, n.getPower());
+  }
+  bool visit(PowerNode &n) override { return set(OpCode::Power); }
+  bool visit(ExpNode &n) override { return set(OpCode::Exp); }
+  bool visit(CteMultNode &n) override {
+    return set(OpCode::Mult, n.getCte());
+  }
+  bool visit(CteDivideNode &n) override {
+    return set(OpCode::Divide, n.getCte());
+  }
+  bool visit(LnNode &n) override { return set(OpCode::Ln); }
+  bool visit(AbsNode &n) override { return set(OpCode::Abs); }
+  bool visit(AvgNode &n) override { return set(OpCode::Avg); }
+  bool visit(InvertNode &n) override { return set(OpCode::Invert); }
+  bool visit(StepNode &n) override { return set(OpCode::Step); }
+
+private:
+  bool set(const OpCode op, const std::optional<double> &cte = {}) {
+    opcode = op;
+    operand = cte;
+    return true;
+  }
+};
+
+double evalNode(const CompactNode &n, const double *values,
+                const uint32_t *inputs, std::vector<double> &scratch) {
+  const uint32_t *in = inputs + n.firstInput;
+  auto x = [&](const int i) { return values[in[i]]; };
+  switch (n.opcode) {
+  case OpCode::Constant:
+    break;
+  case OpCode::Identity:
+    return x(0);
+  case OpCode::Mult:
+  case OpCode::Add:
+  case OpCode::Avg: {
+    scratch.resize(n.nbInputs);
+    for (int i = 0; i < n.nbInputs; ++i)
+      scratch[i] = x(i);
+    const int size = static_cast<int>(n.nbInputs);
+    if (n.opcode == OpCode::Mult)
+      return reduceProduct(scratch.data(), size);
+    if (n.opcode == OpCode::Add)
+      return reduceSum(scratch.data(), size);
+    return reduceSum(scratch.data(), size) / size;
+  }
+  case OpCode::Divide:
+    return x(0) / x(1);
+  case OpCode::Sub:
+    return x(0) - x(1);
+  case OpCode::UnarySub:
+    return -x(0);
+  case OpCode::ReLU:
+    return std::max(0.0, x(0));
+  case OpCode::Sigmoid:
+    return 1.0 / (1 + std::exp(-x(0)));
+  case OpCode::Sine: {
+    const double arg = x(1) * x(0);
+    double sin;
+    sinCos(1, &arg, &sin, nullptr);
+    return sin;
+  }
+  case OpCode::CtePower:
+    return std::pow(x(0), static_cast<int>(x(1)));
+  case OpCode::Power:
+    return std::pow(x(0), x(1));
+  case OpCode::Exp:
+    return std::exp(x(0));
+  case OpCode::Ln:
+    return std::log(x(0));
+  case OpCode::Abs:
+    return std::abs(x(0));
+  case OpCode::Invert:
+    return 1.0 / x(0);
+  case OpCode::Step:
+    return x(0) <= 0 ? 0.0 : 1.0;
+  }
+  // Constants get no pack and are never evaluated
+  return 0.0;
+}
+
+#if defined(__SSE2__)
+// Two records of the same pack at once, operands are gathered in a register
+// and the results scattered back. Returns false for the opcodes left scalar.
+bool evalPair(const CompactNode &n0, const CompactNode &n1, double &value0,
+              double &value1, const double *values, const uint32_t *inputs) {
+  const uint32_t *in0 = inputs + n0.firstInput;
+  const uint32_t *in1 = inputs + n1.firstInput;
+  auto x = [&](const int i) {
+    return _mm_set_pd(values[in1[i]], values[in0[i]]);
+  };
+  __m128d r;
+  switch (n0.opcode) {
+  case OpCode::Identity:
+    r = x(0);
+    break;
+  case OpCode::Mult:
+    if (n0.nbInputs != 2)
+      return false;
+    r = _mm_mul_pd(x(0), x(1));
+    break;
+  case OpCode::Add:
+    if (n0.nbInputs != 2)
+      return false;
+    r = _mm_add_pd(x(0), x(1));
+    break;
+  case OpCode::Divide:
+    r = _mm_div_pd(x(0), x(1));
+    break;
+  case OpCode::Sub:
+    r = _mm_sub_pd(x(0), x(1));
+    break;
+  case OpCode::UnarySub:
+    r = _mm_xor_pd(x(0), _mm_set1_pd(-0.0));
+    break;
+  case OpCode::ReLU:
+    r = _mm_max_pd(x(0), _mm_setzero_pd());
+    break;
+  case OpCode::Step:
+    r = _mm_andnot_pd(_mm_cmple_pd(x(0), _mm_setzero_pd()), _mm_set1_pd(1.0));
+    break;
+  case OpCode::Invert:
+    r = _mm_div_pd(_mm_set1_pd(1.0), x(0));
+    break;
+  default:
+    return false;
+  }
+  _mm_storel_pd(&value0, r);
+  _mm_storeh_pd(&value1, r);
+  return true;
+}
+#endif
+} // namespace
+
+CompactGraph::CompactGraph(
+    const std::vector<std::reference_wrapper<ComputeNode>> &outputs) {
+  // Iterative post-order DFS over the inputs, graphs can be very deep
+  std::vector<std::pair<ComputeNode *, int>> stack;
+  std::unordered_map<ComputeNode *, bool> visited;
+  std::vector<ComputeNode *> order;
+  for (ComputeNode &out : outputs) {
+    if (visited.contains(&out))
+      continue;
+    visited[&out] = true;
+    stack.emplace_back(&out, 0);
+    while (!stack.empty()) {
+      auto &[n, next] = stack.back();
+      if (next < n->nbInputs()) {
+        ComputeNode &in = n->inputAt(next++);
+        if (!visited.contains(&in)) {
+          visited[&in] = true;
+          stack.emplace_back(&in, 0);
+        }
+      } else {
+        order.push_back(n);
+        stack.pop_back();
+      }
+    }
+  }
+
+  auto topology = std::make_shared<Topology>();
+  std::vector<CompactNode> &nodes = topology->nodes;
+  nodes.reserve(order.size());
+  auto state = std::make_shared<State>();
+  state->values.reserve(order.size());
+  _sources.reserve(order.size());
+  topology->ids.reserve(order.size());
+  topology->indices.reserve(order.size());
+  auto addNode = [&](const OpCode opcode, const double value,
+                     ComputeNode *source) {
+    nodes.push_back(
+        {static_cast<uint32_t>(topology->inputs.size()), 0, opcode});
+    state->values.push_back(value);
+    _sources.push_back(source);
+    topology->ids.push_back(source ? source->id() : UINT32_MAX);
+    return static_cast<uint32_t>(nodes.size() - 1);
+  };
+  std::vector<uint32_t> inputs;
+  for (ComputeNode *n : order) {
+    OpCodeVisitor v;
+    n->forwardVisit(v);
+    inputs.clear();
+    for (int i = 0; i < n->nbInputs(); ++i)
+      inputs.push_back(topology->indices.at(&n->inputAt(i)));
+    if (v.operand.has_value())
+      inputs.push_back(addNode(OpCode::Constant, v.operand.value(), nullptr));
+    const uint32_t index =
+        addNode(v.opcode, v.opcode == OpCode::Constant ? n->eval() : 0.0, n);
+    nodes[index].firstInput = static_cast<uint32_t>(topology->inputs.size());
+    nodes[index].nbInputs = static_cast<uint32_t>(inputs.size());
+    topology->inputs.insert(topology->inputs.end(), inputs.begin(),
+                            inputs.end());
+    topology->indices[n] = index;
+  }
+  for (ComputeNode &out : outputs)
+    topology->outputs.push_back(topology->indices.at(&out));
+
+  // Pack schedule: group the records by depth, then opcode and arity.
+  // Constants are never evaluated and get no pack.
+  std::vector<uint32_t> depths(nodes.size(), 0);
+  std::map<std::tuple<uint32_t, OpCode, uint32_t>, std::vector<uint32_t>>
+      groups;
+  for (uint32_t i = 0; i < nodes.size(); ++i) {
+    const CompactNode &n = nodes[i];
+    if (n.opcode == OpCode::Constant)
+      continue;
+    for (uint32_t k = 0; k < n.nbInputs; ++k)
+      depths[i] = std::max(depths[i],
+                           depths[topology->inputs[n.firstInput + k]] + 1);
+    groups[{depths[i], n.opcode, n.nbInputs}].push_back(i);
+  }
+  for (const auto &[key, indices] : groups) {
+    topology->packs.push_back({std::get<1>(key), std::get<2>(key),
+                               static_cast<uint32_t>(topology->packed.size()),
+                               static_cast<uint32_t>(indices.size())});
+    topology->packed.insert(topology->packed.end(), indices.begin(),
+                            indices.end());
+  }
+  state->adjoints.assign(nodes.size(), 0.0);
+  _topology = std::move(topology);
+  _state = std::move(state);
+}
+
+CompactGraph CompactGraph::clone() const {
+  CompactGraph copy;
+  copy._topology = _topology;
+  copy._state = _state;
+  return copy;
+}
+bool CompactGraph::sharesValuesWith(const CompactGraph &other) const {
+  return _state == other._state;
+}
+
+CompactGraph::State &CompactGraph::_own() {
+  if (_state.use_count() > 1)
+    _state = std::make_shared<State>(*_state);
+  return *_state;
+}
+bool CompactGraph::sharesRecordsWith(const CompactGraph &other) const {
+  return _topology == other._topology;
+}
+
+int CompactGraph::nbNodes() const {
+  return static_cast<int>(_topology->nodes.size());
+}
+const CompactNode &CompactGraph::nodeAt(const int index) const {
+  return _topology->nodes[index];
+}
+int CompactGraph::inputAt(const int index, const int slot) const {
+  return static_cast<int>(
+      _topology->inputs[_topology->nodes[index].firstInput + slot]);
+}
+int CompactGraph::indexOf(ComputeNode &node) const {
+  const auto it = _topology->indices.find(&node);
+  return it == _topology->indices.end() ? -1 : static_cast<int>(it->second);
+}
+double CompactGraph::value(const int index) const {
+  return _state->values[index];
+}
+void CompactGraph::setValue(const int index, const double value) {
+  _own().values[index] = value;
+}
+double CompactGraph::adjoint(const int index) const {
+  return _state->adjoints[index];
+}
+std::string CompactGraph::label(const int index) const {
+  if (!_sources.empty() && _sources[index])
+    return _sources[index]->label();
+  return std::to_string(_state->values[index]);
+}
+uint32_t CompactGraph::sourceId(const int index) const {
+  return _topology->ids[index];
+}
+
+void CompactGraph::pull() {
+  assert(!_sources.empty() && "ERROR: a clone has no source graph to pull");
+  const std::vector<CompactNode> &nodes = _topology->nodes;
+  std::vector<double> &values = _own().values;
+  for (int i = 0; i < nodes.size(); ++i)
+    if (nodes[i].opcode == OpCode::Constant && _sources[i])
+      values[i] = _sources[i]->eval();
+}
+
+void CompactGraph::forward() {
+  const CompactNode *nodes = _topology->nodes.data();
+  const uint32_t *inputs = _topology->inputs.data();
+  const uint32_t *packed = _topology->packed.data();
+  double *values = _own().values.data();
+  for (const Pack &p : _topology->packs) {
+    const uint32_t *indices = packed + p.first;
+    // The whole pack in one call of the vectorized sine
+    if (p.opcode == OpCode::Sine) {
+      _scratch.resize(2 * p.size);
+      for (int i = 0; i < p.size; ++i) {
+        const uint32_t *in = inputs + nodes[indices[i]].firstInput;
+        _scratch[i] = values[in[1]] * values[in[0]];
+      }
+      sinCos(static_cast<int>(p.size), _scratch.data(),
+             _scratch.data() + p.size, nullptr);
+      for (int i = 0; i < p.size; ++i)
+        values[indices[i]] = _scratch[p.size + i];
+      continue;
+    }
+    int i = 0;
+#if defined(__SSE2__)
+    for (; i + 2 <= p.size; i += 2) {
+      const uint32_t i0 = indices[i], i1 = indices[i + 1];
+      if (!evalPair(nodes[i0], nodes[i1], values[i0], values[i1], values,
+                    inputs))
+        break;
+    }
+#endif
+    for (; i < p.size; ++i)
+      values[indices[i]] =
+          evalNode(nodes[indices[i]], values, inputs, _scratch);
+  }
+}
+
+void CompactGraph::backward() {
+  const std::vector<CompactNode> &nodes = _topology->nodes;
+  const uint32_t *inputs = _topology->inputs.data();
+  State &state = _own();
+  const double *values = state.values.data();
+  std::vector<double> &adjoints = state.adjoints;
+  std::ranges::fill(adjoints, 0.0);
+  for (const uint32_t o : _topology->outputs)
+    adjoints[o] = 1.0;
+
+  for (int index = static_cast<int>(nodes.size()) - 1; index >= 0; --index) {
+    const CompactNode &n = nodes[index];
+    const double adjoint = adjoints[index];
+    // Nothing flows through a zero adjoint, so the upstream cone of an
+    // inactive ReLU is only reached through its other paths
+    if (adjoint == 0.0)
+      continue;
+    const double value = values[index];
+    const uint32_t *in = inputs + n.firstInput;
+    auto x = [&](const int i) { return values[in[i]]; };
+    auto acc = [&](const int i, const double pdiff) {
+      adjoints[in[i]] += adjoint * pdiff;
+    };
+    switch (n.opcode) {
+    case OpCode::Constant:
+      break;
+    case OpCode::Identity:
+      acc(0, 1.0);
+      break;
+    case OpCode::Mult: {
+      _scratch.resize(2 * n.nbInputs);
+      for (int i = 0; i < n.nbInputs; ++i)
+        _scratch[i] = x(i);
+      const int size = static_cast<int>(n.nbInputs);
+      double *partials = _scratch.data() + size;
+      reduceProductPartials(_scratch.data(), size, partials);
+      for (int i = 0; i < size; ++i)
+        acc(i, partials[i]);
+      break;
+    }
+    case OpCode::Add:
+      for (int i = 0; i < n.nbInputs; ++i)
+        acc(i, 1.0);
+      break;
+    case OpCode::Avg:
+      for (int i = 0; i < n.nbInputs; ++i)
+        acc(i, 1.0 / n.nbInputs);
+      break;
+    case OpCode::Divide:
+      acc(0, 1.0 / x(1));
+      acc(1, -x(0) / (x(1) * x(1)));
+      break;
+    case OpCode::Sub:
+      acc(0, 1.0);
+      acc(1, -1.0);
+      break;
+    case OpCode::UnarySub:
+      acc(0, -1.0);
+      break;
+    case OpCode::ReLU:
+      acc(0, x(0) <= 0 ? 0.0 : 1.0);
+      break;
+    case OpCode::Sigmoid:
+      acc(0, value * (1.0 - value));
+      break;
+    case OpCode::Sine: {
+      const double arg = x(1) * x(0);
+      double cos;
+      sinCos(1, &arg, nullptr, &cos);
+      acc(0, x(1) * cos);
+      break;
+    }
+    case OpCode::CtePower: {
+      const int p = static_cast<int>(x(1));
+      acc(0, p * std::pow(x(0), p - 1));
+      break;
+    }
+    case OpCode::Power:
+      acc(0, x(1) * std::pow(x(0), x(1) - 1));
+      acc(1, value * std::log(x(0)));
+      break;
+    case OpCode::Exp:
+      acc(0, value);
+      break;
+    case OpCode::Ln:
+      acc(0, 1.0 / x(0));
+      break;
+    case OpCode::Abs:
+      acc(0, x(0) == 0.0 ? 0.0 : (x(0) < 0 ? -1.0 : 1.0));
+      break;
+    case OpCode::Invert:
+      acc(0, -value * value);
+      break;
+    case OpCode::Step:
+      break;
+    }
+  }
+}
+
+} // namespace ml
@@ -0,0 +1,215 @@
+#include "libml/compute/gradient.h"
+
+#include <initializer_list>
+#include <numbers>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace ml {
+
+namespace {
+// Builds the contribution of one input slot of a node to the adjoint of that
+// input: the local partial expression multiplied by the node adjoint.
+// Leaves result null when the partial is zero everywhere.
+class PartialVisitor final : public ComputeNodeVisitor {
+public:
+  PartialVisitor(IComputeGraph &graph, ComputeNode &adjoint, const int slot)
+      : _graph(graph), _f(graph.nodeFactory()), _adj(adjoint), _slot(slot) {}
+  ComputeNode *result = nullptr;
+
+  bool visit(IdentityNode &n) override { return set(_adj); }
+  bool visit(ConstantNode &n) override { return true; }
+  bool visit(MultNode &n) override {
+    ComputeNode &m = _f.createMultNode();
+    connect(m, {&_adj});
+    for (int i = 0; i < n.nbInputs(); ++i)
+      if (i != _slot)
+        connect(m, {&n.inputAt(i)});
+    return set(m);
+  }
+  bool visit(DivideNode &n) override {
+    ComputeNode &x = n.inputAt(0);
+    ComputeNode &y = n.inputAt(1);
+    if (_slot == 0)
+      return set(connect(_f.createDivideNode(), {&_adj, &y}));
+    // - adj * x / y^2
+    ComputeNode &y2 = connect(_f.createCtePowerNode(2), {&y});
+    ComputeNode &q = connect(_f.createDivideNode(), {&x, &y2});
+    ComputeNode &m = connect(_f.createMultNode(), {&_adj, &q});
+    return set(connect(_f.createUnarySubNode(), {&m}));
+  }
+  bool visit(UnarySubNode &n) override {
+    return set(connect(_f.createUnarySubNode(), {&_adj}));
+  }
+  bool visit(SubNode &n) override {
+    if (_slot == 0)
+      return set(_adj);
+    return set(connect(_f.createUnarySubNode(), {&_adj}));
+  }
+  bool visit(AddNode &n) override { return set(_adj); }
+  bool visit(ReLUNode &n) override {
+    ComputeNode &step = connect(_f.createStepNode(), {&n.inputAt(0)});
+    return set(connect(_f.createMultNode(), {&_adj, &step}));
+  }
+  bool visit(SigmoidNode &n) override {
+    // adj * s * (1 - s)
+    ConstantNode &one = _f.createConstantNode(1.0);
+    ComputeNode &sub = connect(_f.createSubNode(), {&one, &n});
+    return set(connect(_f.createMultNode(), {&_adj, &n, &sub}));
+  }
+  bool visit(SineNode &n) override {
+    // adj * w * cos(w x), with cos(w x) = sin(w (x + pi / 2w))
+    const double w = n.getOmega();
+    ConstantNode &shift = _f.createConstantNode(std::numbers::pi / (2 * w));
+    ComputeNode &x = connect(_f.createAddNode(), {&n.inputAt(0), &shift});
+    ComputeNode &cos = connect(_f.createSineNode(w), {&x});
+    ComputeNode &m = connect(_f.createMultNode(), {&_adj, &cos});
+    return set(connect(_f.createCteMultNode(w), {&m}));
+  }
+  bool visit(CtePowerNode &n) override {
+    const int p = n.getPower();
+    ComputeNode &pow = connect(_f.createCtePowerNode(p - 1), {&n.inputAt(0)});
+    ComputeNode &m = connect(_f.createMultNode(), {&_adj, &pow});
+    return set(connect(_f.createCteMultNode(p), {&m}));
+  }
+  bool visit(PowerNode &n) override {
+    ComputeNode &x = n.inputAt(0);
+    ComputeNode &y = n.inputAt(1);
+    if (_slot == 0) {
+      // adj * y * x^(y - 1)
+      ConstantNode &one = _f.createConstantNode(1.0);
+      ComputeNode &e = connect(_f.createSubNode(), {&y, &one});
+      ComputeNode &pow = connect(_f.createPowerNode(), {&x, &e});
+      return set(connect(_f.createMultNode(), {&_adj, &y, &pow}));
+    }
+    // adj * x^y * ln(x)
+    ComputeNode &ln = connect(_f.createLnNode(), {&x});
+    return set(connect(_f.createMultNode(), {&_adj, &n, &ln}));
+  }
+  bool visit(ExpNode &n) override {
+    return set(connect(_f.createMultNode(), {&_adj, &n}));
+  }
+  bool visit(CteMultNode &n) override {
+    return set(connect(_f.createCteMultNode(n.getCte()), {&_adj}));
+  }
+  bool visit(CteDivideNode &n) override {
+    return set(connect(_f.createCteDivNode(n.getCte()), {&_adj}));
+  }
+  bool visit(LnNode &n) override {
+    return set(connect(_f.createDivideNode(), {&_adj, &n.inputAt(0)}));
+  }
+  bool visit(AbsNode &n) override {
+    // sign(x) = step(x) - step(-x), zero at zero like AbsNode::pdiff
+    ComputeNode &x = n.inputAt(0);
+    ComputeNode &neg = connect(_f.createUnarySubNode(), {&x});
+    ComputeNode &pos = connect(_f.createStepNode(), {&x});
+    ComputeNode &negStep = connect(_f.createStepNode(), {&neg});
+    ComputeNode &sign = connect(_f.createSubNode(), {&pos, &negStep});
+    return set(connect(_f.createMultNode(), {&_adj, &sign}));
+  }
+  bool visit(AvgNode &n) override {
+    return set(connect(_f.createCteDivNode(n.nbInputs()), {&_adj}));
+  }
+  bool visit(InvertNode &n) override {
+    // -1/x^2 = -(1/x)^2
+    ComputeNode &m = connect(_f.createMultNode(), {&_adj, &n, &n});
+    return set(connect(_f.createUnarySubNode(), {&m}));
+  }
+  bool visit(StepNode &n) override { return true; }
+
+private:
+  IComputeGraph &_graph;
+  NodeFactory &_f;
+  ComputeNode &_adj;
+  int _slot;
+
+  ComputeNode &connect(ComputeNode &node,
+                       const std::initializer_list<ComputeNode *> inputs) {
+    for (ComputeNode *in : inputs)
+      _graph.createEdge(*in, node, {});
+    return node;
+  }
+  bool set(ComputeNode &node) {
+    result = &node;
+    return true;
+  }
+};
+} // namespace
+
+SymbolicGradient::SymbolicGradient(
+    IComputeGraph &graph, ComputeNode &output,
+    const std::vector<std::reference_wrapper<ComputeNode>> &wrt)
+    : ComputeSubGraph(graph) {
+  // Topological order of the output cone, inputs first
+  std::vector<ComputeNode *> order;
+  std::unordered_set<ComputeNode *> visited = {&output};
+  std::vector<std::pair<ComputeNode *, int>> stack = {{&output, 0}};
+  while (!stack.empty()) {
+    auto &[n, next] = stack.back();
+    if (next < n->nbInputs()) {
+      ComputeNode &in = n->inputAt(next++);
+      if (visited.insert(&in).second)
+        stack.emplace_back(&in, 0);
+    } else {
+      order.push_back(n);
+      stack.pop_back();
+    }
+  }
+
+  // Only nodes depending on one of the wrt nodes need an adjoint
+  std::unordered_set<ComputeNode *> relevant;
+  for (ComputeNode &w : wrt)
+    relevant.insert(&w);
+  for (ComputeNode *n : order)
+    for (int i = 0; i < n->nbInputs(); ++i)
+      if (relevant.contains(&n->inputAt(i)))
+        relevant.insert(n);
+
+  // Reverse sweep, every consumer of a node is handled before the node
+  // itself so its adjoint contributions are complete when it is reached
+  std::unordered_map<ComputeNode *, std::vector<ComputeNode *>> contributions;
+  std::unordered_map<ComputeNode *, ComputeNode *> adjoints;
+  ConstantNode &seed = nodeFactory().createConstantNode(1.0);
+  seed.setLabelPrefix("G: ");
+  contributions[&output] = {&seed};
+  for (auto it = order.rbegin(); it != order.rend(); ++it) {
+    ComputeNode *n = *it;
+    if (!relevant.contains(n) || !contributions.contains(n))
+      continue;
+    std::vector<ComputeNode *> &terms = contributions[n];
+    ComputeNode *adj = terms[0];
+    if (terms.size() > 1) {
+      adj = &nodeFactory().createAddNode();
+      for (ComputeNode *t : terms)
+        createEdge(*t, *adj, {});
+    }
+    adjoints[n] = adj;
+    for (int i = 0; i < n->nbInputs(); ++i) {
+      ComputeNode &in = n->inputAt(i);
+      if (!relevant.contains(&in))
+        continue;
+      PartialVisitor v(*this, *adj, i);
+      n->forwardVisit(v);
+      if (v.result)
+        contributions[&in].push_back(v.result);
+    }
+  }
+
+  for (ComputeNode &w : wrt) {
+    if (adjoints.contains(&w))
+      _gradients.push_back(adjoints[&w]);
+    else
+      _gradients.push_back(&nodeFactory().createConstantNode(0.0));
+  }
+  for (int i = 0; i < nbNodes(); ++i)
+    nodeAt(i)._flags |= ComputeNode::SYMBOLIC;
+}
+
+ComputeNode &SymbolicGradient::gradient(const int index) const {
+  return *_gradients[index];
+}
+int SymbolicGradient::size() const {
+  return static_cast<int>(_gradients.size());
+}
+
+} // namespace ml
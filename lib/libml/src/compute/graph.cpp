@@ -1,9 +1,38 @@
 #include "libml/compute/graph.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <exception>
+#include <mutex>
+#include <numeric>
+#include <ranges>
+#include <thread>
+#include <unordered_set>
+#include <utility>
 
 namespace ml {
 
+namespace {
+// Ids are compacted once more than this fraction of them is free
+constexpr double MAX_FREE_IDS_RATIO = 0.5;
+constexpr uint32_t MIN_COMPACT_IDS = 1024;
+
+// Refills the cached ends in place, their capacity is kept between calls
+void collectEnds(const std::vector<ComputeNode *> &nodes,
+                 std::vector<std::reference_wrapper<ComputeNode>> &inputs,
+                 std::vector<std::reference_wrapper<ComputeNode>> &outputs) {
+  inputs.clear();
+  outputs.clear();
+  for (ComputeNode *n : nodes) {
+    if (n->nbInputs() == 0)
+      inputs.push_back(*n);
+    if (n->nbOutputs() == 0)
+      outputs.push_back(*n);
+  }
+}
+} // namespace
+
 bool ComputeEdge::operator==(const ComputeEdge &e) const {
   return src == e.src && dst == e.dst && slot == e.slot;
 }
@@ -15,133 +44,391 @@ bool ComputeEdge::operator<(const ComputeEdge &e) const {
 ComputeGraph::ComputeGraph() : _nodeFactory(*this) {}
 
 ComputeGraph::~ComputeGraph() {
+  _dropRemoved();
   for (const auto n : _nodes)
     delete n;
 }
 
-std::vector<std::reference_wrapper<ComputeNode>>
+std::span<const std::reference_wrapper<ComputeNode>>
 ComputeGraph::getInputsNodes() {
-  std::vector<std::reference_wrapper<ComputeNode>> v;
-  for (ComputeNode *n : _nodes)
-    if (n->nbInputs() == 0)
-      v.push_back(*n);
-  return std::move(v);
+  if (_endsVersion != _version) {
+    _packNodes();
+    collectEnds(_nodes, _inputNodes, _outputNodes);
+    _endsVersion = _version;
+  }
+  return _inputNodes;
 }
-std::vector<std::reference_wrapper<ComputeNode>>
+std::span<const std::reference_wrapper<ComputeNode>>
 ComputeGraph::getOutputNodes() {
-  std::vector<std::reference_wrapper<ComputeNode>> v;
-  for (ComputeNode *n : _nodes)
-    if (n->nbOutputs() == 0)
-      v.push_back(*n);
-  return std::move(v);
+  getInputsNodes();
+  return _outputNodes;
 }
 
-uint32_t ComputeGraph::newId() { return _nextId++; }
+uint32_t ComputeGraph::newId() {
+  if (NodeBlock *b = NodeBlock::active())
+    return b->deferId();
+  if (!_freeIds.empty()) {
+    const uint32_t id = _freeIds.back();
+    _freeIds.pop_back();
+    return id;
+  }
+  return _nextId++;
+}
 
 ComputeEdge ComputeGraph::createEdge(ComputeNode &src, ComputeNode &dst,
                                      const std::optional<int> &slot) {
-  int newSlot = src.connect(dst, slot);
-  ComputeEdge e = {&src, &dst, newSlot};
-  if (std::find(_edges.begin(), _edges.end(), e) == _edges.end()) {
-    _edges.push_back(e);
-  }
+  return createEdge(src, dst, slot, nullptr);
+}
+
+ComputeEdge ComputeGraph::createEdge(ComputeNode &src, ComputeNode &dst,
+                                     const std::optional<int> &slot,
+                                     ComputeSubGraph *owner) {
+  if (NodeBlock *b = NodeBlock::active())
+    return b->deferEdge(owner ? static_cast<IComputeGraph &>(*owner) : *this,
+                        src, dst, slot);
+  // The edges mirror the input slots: an edge already exists exactly when
+  // its slot already holds src. It keeps its first owner.
+  const int target = slot.value_or(dst.nbInputs());
+  if (dst.hasInput(target) && &dst.inputAt(target) == &src)
+    return {&src, &dst, target};
+  _dropRemoved();
+  src.connect(dst, target);
+  ComputeEdge e = {&src, &dst, target};
+  _edges.push_back(e);
+  _edgeOwners.push_back(owner);
+  ++_version;
   return e;
 }
 
 void ComputeGraph::removeEdge(ComputeEdge &edge) {
+  _dropRemoved();
   edge.src->disconnect(*edge.dst);
-  std::remove(_edges.begin(), _edges.end(), edge);
+  const auto it = std::ranges::find(_edges, edge);
+  if (it != _edges.end()) {
+    _edgeOwners.erase(_edgeOwners.begin() + (it - _edges.begin()));
+    _edges.erase(it);
+  }
+  ++_version;
 }
 
-std::vector<ComputeEdge> &ComputeGraph::getEdges() { return _edges; }
+std::vector<ComputeEdge> &ComputeGraph::getEdges() {
+  _dropRemoved();
+  return _edges;
+}
 
 void ComputeGraph::removeNode(ComputeNode &node) {
+  const uint32_t id = node.id();
+  if (ComputeSubGraph *owner = _owners[id])
+    owner->_forget(node);
   node.clearConnections();
-  std::erase_if(_edges, [&node](ComputeEdge &e) {
-    return e.src == &node || e.dst == &node;
-  });
-  _nodes.erase(std::ranges::find(_nodes, &node));
-  if (node.decOwnerCount() == 0)
-    delete &node;
+  _owners[id] = nullptr;
+  _nodes[_positions[id]] = nullptr;
+  ++_nbRemoved;
+  // Edges are dropped in one pass once a batch of removals is done
+  _removed.push_back(&node);
+  _freeIds.push_back(id);
+  ++_version;
+  if (_nextId >= MIN_COMPACT_IDS &&
+      _freeIds.size() > MAX_FREE_IDS_RATIO * _nextId)
+    compact();
+}
+
+void ComputeGraph::compact() {
+  _dropRemoved();
+  _packNodes();
+  std::vector<ComputeSubGraph *> owners(_nodes.size());
+  for (int i = 0; i < _nodes.size(); ++i) {
+    owners[i] = _owners[_nodes[i]->_id];
+    _nodes[i]->_id = static_cast<uint32_t>(i);
+  }
+  _owners = std::move(owners);
+  _positions.resize(_nodes.size());
+  std::iota(_positions.begin(), _positions.end(), 0);
+  _freeIds.clear();
+  _nextId = static_cast<uint32_t>(_nodes.size());
+  ++_version;
+}
+
+int ComputeGraph::nbFreeIds() const {
+  return static_cast<int>(_freeIds.size());
+}
+
+void ComputeGraph::_dropRemoved() {
+  if (!_destroyed.empty()) {
+    // Up to the first live parent, nested subgraphs die before their parent
+    for (ComputeSubGraph *&owner : _edgeOwners)
+      for (auto it = _destroyed.find(owner); it != _destroyed.end();
+           it = _destroyed.find(owner))
+        owner = it->second;
+    _destroyed.clear();
+  }
+  if (_removed.empty())
+    return;
+  std::unordered_set<ComputeNode *> removed(_removed.begin(), _removed.end());
+  int j = 0;
+  for (int i = 0; i < _edges.size(); ++i) {
+    if (removed.contains(_edges[i].src) || removed.contains(_edges[i].dst))
+      continue;
+    _edges[j] = _edges[i];
+    _edgeOwners[j] = _edgeOwners[i];
+    ++j;
+  }
+  _edges.resize(j);
+  _edgeOwners.resize(j);
+  for (ComputeNode *n : _removed)
+    delete n;
+  _removed.clear();
+}
+
+void ComputeGraph::_packNodes() const {
+  if (_nbRemoved == 0)
+    return;
+  std::erase(_nodes, nullptr);
+  for (int i = 0; i < _nodes.size(); ++i)
+    _positions[_nodes[i]->id()] = i;
+  _nbRemoved = 0;
 }
 
 ComputeNode &ComputeGraph::nodeAt(const int index) const {
+  _packNodes();
   return *_nodes[index];
 }
 
-int ComputeGraph::nbNodes() const { return static_cast<int>(_nodes.size()); }
+int ComputeGraph::nbNodes() const {
+  return static_cast<int>(_nodes.size()) - _nbRemoved;
+}
 NodeFactory &ComputeGraph::nodeFactory() { return _nodeFactory; }
 
 void ComputeGraph::registerNode(std::unique_ptr<ComputeNode> node) {
-  node->incOwnerCount();
+  registerNode(std::move(node), nullptr);
+}
+
+void ComputeGraph::registerNode(std::unique_ptr<ComputeNode> node,
+                                ComputeSubGraph *owner) {
+  if (NodeBlock *b = NodeBlock::active())
+    return b->deferNode(owner ? static_cast<IComputeGraph &>(*owner) : *this,
+                        std::move(node));
+  // Removed nodes must be gone before their address can be reused
+  _dropRemoved();
+  const uint32_t id = node->id();
+  assert(id != UINT32_MAX && "Node registered without an id");
+  if (id >= _owners.size()) {
+    _owners.resize(id + 1, nullptr);
+    _positions.resize(id + 1, -1);
+  }
+  _owners[id] = owner;
+  _positions[id] = static_cast<int>(_nodes.size());
+  if (owner)
+    owner->_ownNodes.push_back(node.get());
   _nodes.push_back(node.release());
+  ++_version;
+}
+
+ComputeGraph &ComputeGraph::rootGraph() { return *this; }
+
+ComputeSubGraph *ComputeGraph::ownerOf(ComputeNode &node) {
+  return _owners[node.id()];
+}
+
+ComputeSubGraph *ComputeGraph::edgeOwner(const int index) {
+  _dropRemoved();
+  return _edgeOwners[index];
 }
 
+bool ComputeGraph::isWithin(ComputeSubGraph *owner,
+                            const ComputeSubGraph &graph) const {
+  for (; owner; owner = owner->parentSubGraph())
+    if (owner == &graph)
+      return true;
+  return false;
+}
+
+uint64_t ComputeGraph::version() const { return _version; }
+
 // SUB GRAPH
 ComputeSubGraph::ComputeSubGraph(IComputeGraph &graph)
-    : _graph(graph), _nodeFactory(*this) {}
+    : _graph(graph), _root(graph.rootGraph()),
+      _parent(&graph == &_root ? nullptr
+                               : static_cast<ComputeSubGraph *>(&graph)),
+      _nodeFactory(*this) {}
 
 ComputeSubGraph::~ComputeSubGraph() {
-  for (const auto n : _nodes) {
-    n->decOwnerCount();
-    _graph.removeNode(*n);
-  }
+  // Nested subgraphs are destroyed first and have removed their own nodes
+  for (ComputeNode *n : std::exchange(_ownNodes, {}))
+    _root.removeNode(*n);
+  // Nothing is tagged with a new subgraph at the same address before the
+  // next drop, every registration drops first
+  _root._destroyed.emplace(this, _parent);
+}
+
+void ComputeSubGraph::_forget(ComputeNode &node) {
+  // From the end, the most recent nodes are usually removed first
+  if (const auto it = std::ranges::find(_ownNodes | std::views::reverse, &node);
+      it != _ownNodes.rend())
+    _ownNodes.erase(std::next(it).base());
+}
+
+void ComputeSubGraph::_updateView() const {
+  _root._dropRemoved();
+  if (_viewVersion == _root.version())
+    return;
+  _root._packNodes();
+  _viewNodes.clear();
+  for (ComputeNode *n : _root._nodes)
+    if (_root.isWithin(_root._owners[n->id()], *this))
+      _viewNodes.push_back(n);
+  _viewEdges.clear();
+  for (int i = 0; i < _root._edges.size(); ++i)
+    if (_root.isWithin(_root._edgeOwners[i], *this))
+      _viewEdges.push_back(_root._edges[i]);
+  collectEnds(_viewNodes, _inputNodes, _outputNodes);
+  _viewVersion = _root.version();
 }
 
-std::vector<std::reference_wrapper<ComputeNode>>
+std::span<const std::reference_wrapper<ComputeNode>>
 ComputeSubGraph::getInputsNodes() {
-  std::vector<std::reference_wrapper<ComputeNode>> v;
-  for (ComputeNode *n : _nodes)
-    if (n->nbInputs() == 0)
-      v.push_back(*n);
-  return std::move(v);
+  _updateView();
+  return _inputNodes;
 }
-std::vector<std::reference_wrapper<ComputeNode>>
+std::span<const std::reference_wrapper<ComputeNode>>
 ComputeSubGraph::getOutputNodes() {
-  std::vector<std::reference_wrapper<ComputeNode>> v;
-  for (ComputeNode *n : _nodes)
-    if (n->nbOutputs() == 0)
-      v.push_back(*n);
-  return std::move(v);
+  getInputsNodes();
+  return _outputNodes;
 }
 
-uint32_t ComputeSubGraph::newId() { return _graph.newId(); }
+uint32_t ComputeSubGraph::newId() { return _root.newId(); }
 
 ComputeEdge ComputeSubGraph::createEdge(ComputeNode &src, ComputeNode &dst,
                                         const std::optional<int> &slot) {
-  ComputeEdge e = _graph.createEdge(src, dst, slot);
-  if (std::find(_edges.begin(), _edges.end(), e) == _edges.end()) {
-    _edges.push_back(e);
-  }
-  return e;
+  return _root.createEdge(src, dst, slot, this);
 }
 
-void ComputeSubGraph::removeEdge(ComputeEdge &edge) {
-  std::remove(_edges.begin(), _edges.end(), edge);
-  _graph.removeEdge(edge);
-}
+void ComputeSubGraph::removeEdge(ComputeEdge &edge) { _root.removeEdge(edge); }
 
-std::vector<ComputeEdge> &ComputeSubGraph::getEdges() { return _edges; }
-
-void ComputeSubGraph::removeNode(ComputeNode &node) {
-  node.decOwnerCount();
-  std::erase_if(_edges, [&node](ComputeEdge &e) {
-    return e.src == &node || e.dst == &node;
-  });
-  _nodes.erase(std::ranges::find(_nodes, &node));
-  _graph.removeNode(node);
+std::vector<ComputeEdge> &ComputeSubGraph::getEdges() {
+  _updateView();
+  return _viewEdges;
 }
 
+void ComputeSubGraph::removeNode(ComputeNode &node) { _root.removeNode(node); }
+
 ComputeNode &ComputeSubGraph::nodeAt(const int index) const {
-  return *_nodes[index];
+  _updateView();
+  return *_viewNodes[index];
+}
+int ComputeSubGraph::nbNodes() const {
+  _updateView();
+  return static_cast<int>(_viewNodes.size());
 }
-int ComputeSubGraph::nbNodes() const { return static_cast<int>(_nodes.size()); }
 NodeFactory &ComputeSubGraph::nodeFactory() { return _nodeFactory; }
 void ComputeSubGraph::registerNode(std::unique_ptr<ComputeNode> node) {
-  node->incOwnerCount();
-  _nodes.push_back(node.get());
-  _graph.registerNode(std::move(node));
+  _root.registerNode(std::move(node), this);
 }
 IComputeGraph &ComputeSubGraph::baseGraph() const { return _graph; }
+ComputeGraph &ComputeSubGraph::rootGraph() { return _root; }
+ComputeSubGraph *ComputeSubGraph::parentSubGraph() const { return _parent; }
+
+// NODE BLOCK
+namespace {
+thread_local NodeBlock *activeBlock = nullptr;
+// Below this, starting threads costs more than building the nodes
+constexpr int MIN_PARALLEL_TASKS = 32;
+std::atomic<int> buildThreads = 0;
+} // namespace
+
+NodeBlock *NodeBlock::active() { return activeBlock; }
+
+uint32_t NodeBlock::deferId() { return UINT32_MAX; }
+
+void NodeBlock::deferNode(IComputeGraph &graph,
+                          std::unique_ptr<ComputeNode> node) {
+  _registrations.push_back({&graph, std::move(node), nullptr, nullptr, -1});
+}
+
+ComputeEdge NodeBlock::deferEdge(IComputeGraph &graph, ComputeNode &src,
+                                 ComputeNode &dst,
+                                 const std::optional<int> &slot) {
+  // Only read here, the inputs of dst do not change until the merge
+  auto [it, added] = _nextSlots.try_emplace(&dst, dst.nbInputs());
+  const int target = slot.value_or(it->second);
+  it->second = std::max(it->second, target + 1);
+  _registrations.push_back({&graph, nullptr, &src, &dst, target});
+  return {&src, &dst, target};
+}
+
+void NodeBlock::endTask() {
+  _taskEnds.push_back(static_cast<int>(_registrations.size()));
+}
+
+void NodeBlock::merge(const int task) {
+  const int end = _taskEnds[task];
+  for (int i = task == 0 ? 0 : _taskEnds[task - 1]; i < end; ++i) {
+    Registration &r = _registrations[i];
+    if (r.node) {
+      r.node->_id = r.graph->newId();
+      r.graph->registerNode(std::move(r.node));
+      continue;
+    }
+    assert((!r.dst->hasInput(r.slot) || &r.dst->inputAt(r.slot) == r.src) &&
+           "ERROR: two blocks connected the same input slot");
+    r.graph->createEdge(*r.src, *r.dst, r.slot);
+  }
+}
+
+void buildGridInParallel(const int nbRows, const int nbColumns,
+                         const std::function<void(int, int)> &task) {
+  const int nbThreads = std::min(
+      nbColumns, buildThreads > 0
+                     ? buildThreads.load()
+                     : static_cast<int>(std::thread::hardware_concurrency()));
+  // Nested calls record into the block of the task they belong to
+  if (NodeBlock::active() || nbThreads < 2 ||
+      nbRows * nbColumns < MIN_PARALLEL_TASKS) {
+    for (int i = 0; i < nbRows; ++i)
+      for (int j = 0; j < nbColumns; ++j)
+        task(i, j);
+    return;
+  }
+
+  std::vector<NodeBlock> blocks(nbColumns);
+  std::atomic<int> next = 0;
+  // An exception escaping a jthread terminates, the first one is kept and
+  // the remaining columns are skipped
+  std::exception_ptr error;
+  std::mutex errorMutex;
+  {
+    std::vector<std::jthread> workers;
+    for (int t = 0; t < nbThreads; ++t)
+      workers.emplace_back([&] {
+        for (int j = next++; j < nbColumns; j = next++) {
+          activeBlock = &blocks[j];
+          try {
+            for (int i = 0; i < nbRows; ++i) {
+              task(i, j);
+              blocks[j].endTask();
+            }
+          } catch (...) {
+            std::lock_guard lock(errorMutex);
+            if (!error)
+              error = std::current_exception();
+            next = nbColumns;
+          }
+          activeBlock = nullptr;
+        }
+      });
+  }
+  if (error)
+    std::rethrow_exception(error);
+  for (int i = 0; i < nbRows; ++i)
+    for (NodeBlock &b : blocks)
+      b.merge(i);
+}
+
+void buildInParallel(const int nbTasks,
+                     const std::function<void(int)> &task) {
+  buildGridInParallel(1, nbTasks, [&](int, const int j) { task(j); });
+}
+
+void setBuildThreads(const int nbThreads) { buildThreads = nbThreads; }
 
 } // namespace ml
\ No newline at end of file
@@ -0,0 +1,568 @@
+#include "libml/compute/kernels.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cassert>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define ML_KERNELS_DISPATCH
+#endif
+
+namespace ml {
+
+namespace {
+
+// Outputs of the packed int8 matrices are padded to whole blocks of 16, the
+// int32 lanes of the widest registers
+constexpr int INT8_BLOCK = 16;
+int int8Rows(const int m) {
+  return (m + INT8_BLOCK - 1) / INT8_BLOCK * INT8_BLOCK;
+}
+
+// Conversions of one value, for the tails of the kernels
+template <HalfFormat F> float halfToFloat(const uint16_t h) {
+  if constexpr (F == HalfFormat::BF16)
+    return std::bit_cast<float>(static_cast<uint32_t>(h) << 16);
+  // Exponent and mantissa at their float place, rebiased by the product:
+  // exact for the subnormals too, infinities and NaN overflow past 65536
+  float x = std::bit_cast<float>(static_cast<uint32_t>(h & 0x7fff) << 13) *
+            0x1p112f;
+  uint32_t bits = std::bit_cast<uint32_t>(x);
+  if (x >= 65536.0f)
+    bits |= 0x7f800000;
+  return std::bit_cast<float>(bits | static_cast<uint32_t>(h & 0x8000) << 16);
+}
+
+template <HalfFormat F> uint16_t floatToHalf(const float x) {
+  uint32_t bits = std::bit_cast<uint32_t>(x);
+  if constexpr (F == HalfFormat::BF16) {
+    // Quiet NaN, the rounding could carry into the exponent
+    if (x != x)
+      return static_cast<uint16_t>(bits >> 16 | 0x40);
+    return static_cast<uint16_t>((bits + 0x7fff + (bits >> 16 & 1)) >> 16);
+  }
+  const uint32_t sign = bits & 0x80000000;
+  bits ^= sign;
+  uint32_t h;
+  if (bits >= 0x47800000) {
+    // Overflow to infinity, NaN stays NaN
+    h = bits > 0x7f800000 ? 0x7e00 : 0x7c00;
+  } else if (bits < 0x38800000) {
+    // Subnormal: adding 0.5 aligns the mantissa and rounds it
+    h = std::bit_cast<uint32_t>(std::bit_cast<float>(bits) + 0.5f) -
+        0x3f000000;
+  } else {
+    // Rebias, then round to the nearest even on the dropped 13 bits
+    bits += 0xc8000fff + (bits >> 13 & 1);
+    h = bits >> 13;
+  }
+  return static_cast<uint16_t>(h | sign >> 16);
+}
+
+// KERNELS
+// Each namespace wraps one register type in Ops, the kernels compiled
+// against it live next to it
+
+namespace scalar {
+struct Ops {
+  using V = double;
+  static constexpr int W = 1;
+  static V zero() { return 0.0; }
+  static V set1(const double x) { return x; }
+  static V load(const double *p) { return *p; }
+  static void store(double *p, const V v) { *p = v; }
+  static V add(const V a, const V b) { return a + b; }
+  static V sub(const V a, const V b) { return a - b; }
+  static V mul(const V a, const V b) { return a * b; }
+  static V fma(const V a, const V b, const V c) { return a * b + c; }
+  static double sum(const V v) { return v; }
+  static V gather(const double *p, const int *index) { return p[*index]; }
+  // One int32 sum in lo
+  struct VI {
+    int32_t lo, hi;
+  };
+  static constexpr int NI = 1;
+  static VI zeroI() { return {0, 0}; }
+  static VI loadPairs(const int8_t *p) { return {p[0], p[1]}; }
+  static VI pair(const int16_t a, const int16_t b) { return {a, b}; }
+  static VI madd(const VI a, const VI b, const VI acc) {
+    return {acc.lo + a.lo * b.lo + a.hi * b.hi, 0};
+  }
+  static void storeI(int32_t *p, const VI v) { *p = v.lo; }
+  using VF = float;
+  static constexpr int NF = 1;
+  static VF set1F(const float x) { return x; }
+  static VF loadF(const float *p) { return *p; }
+  static void storeF(float *p, const VF v) { *p = v; }
+  static VF fmaF(const VF a, const VF b, const VF c) { return a * b + c; }
+  template <HalfFormat F> static VF loadHalf(const uint16_t *p) {
+    return halfToFloat<F>(*p);
+  }
+  template <HalfFormat F> static void storeHalf(uint16_t *p, const VF v) {
+    *p = floatToHalf<F>(v);
+  }
+};
+#include "kernels_impl.h"
+} // namespace scalar
+
+#if defined(ML_KERNELS_DISPATCH)
+// Always there on x86-64
+namespace sse2 {
+struct Ops {
+  using V = __m128d;
+  static constexpr int W = 2;
+  static V zero() { return _mm_setzero_pd(); }
+  static V set1(const double x) { return _mm_set1_pd(x); }
+  static V load(const double *p) { return _mm_loadu_pd(p); }
+  static void store(double *p, const V v) { _mm_storeu_pd(p, v); }
+  static V add(const V a, const V b) { return _mm_add_pd(a, b); }
+  static V sub(const V a, const V b) { return _mm_sub_pd(a, b); }
+  static V mul(const V a, const V b) { return _mm_mul_pd(a, b); }
+  static V fma(const V a, const V b, const V c) {
+    return _mm_add_pd(_mm_mul_pd(a, b), c);
+  }
+  static double sum(const V v) {
+    return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+  }
+  static V gather(const double *p, const int *index) {
+    return _mm_set_pd(p[index[1]], p[index[0]]);
+  }
+  // int32 lanes, each one the sum of the products of a pair of int16
+  using VI = __m128i;
+  static constexpr int NI = 4;
+  static VI zeroI() { return _mm_setzero_si128(); }
+  static VI loadPairs(const int8_t *p) {
+    // Each byte in the high half of its int16, then shifted with its sign
+    const __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p));
+    return _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8);
+  }
+  static VI pair(const int16_t a, const int16_t b) {
+    return _mm_set1_epi32(static_cast<uint16_t>(a) | b << 16);
+  }
+  static VI madd(const VI a, const VI b, const VI acc) {
+    return _mm_add_epi32(acc, _mm_madd_epi16(a, b));
+  }
+  static void storeI(int32_t *p, const VI v) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v);
+  }
+  using VF = __m128;
+  static constexpr int NF = 4;
+  static VF set1F(const float x) { return _mm_set1_ps(x); }
+  static VF loadF(const float *p) { return _mm_loadu_ps(p); }
+  static void storeF(float *p, const VF v) { _mm_storeu_ps(p, v); }
+  static VF fmaF(const VF a, const VF b, const VF c) {
+    return _mm_add_ps(_mm_mul_ps(a, b), c);
+  }
+  template <HalfFormat F> static VF loadHalf(const uint16_t *p) {
+    const __m128i h = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p));
+    if constexpr (F == HalfFormat::BF16)
+      return _mm_castsi128_ps(_mm_unpacklo_epi16(_mm_setzero_si128(), h));
+    // No F16C, same steps as halfToFloat
+    const __m128i w = _mm_unpacklo_epi16(h, _mm_setzero_si128());
+    const __m128 x = _mm_mul_ps(
+        _mm_castsi128_ps(
+            _mm_slli_epi32(_mm_and_si128(w, _mm_set1_epi32(0x7fff)), 13)),
+        _mm_set1_ps(0x1p112f));
+    const __m128 special =
+        _mm_and_ps(_mm_cmpge_ps(x, _mm_set1_ps(65536.0f)),
+                   _mm_castsi128_ps(_mm_set1_epi32(0x7f800000)));
+    const __m128 sign = _mm_castsi128_ps(
+        _mm_slli_epi32(_mm_and_si128(w, _mm_set1_epi32(0x8000)), 16));
+    return _mm_or_ps(_mm_or_ps(x, special), sign);
+  }
+  template <HalfFormat F> static void storeHalf(uint16_t *p, const VF v) {
+    alignas(16) float t[NF];
+    _mm_store_ps(t, v);
+    for (int i = 0; i < NF; ++i)
+      p[i] = floatToHalf<F>(t[i]);
+  }
+};
+#include "kernels_impl.h"
+} // namespace sse2
+
+// The wider instruction sets are only enabled for their own namespace, the
+// rest of the binary still runs on any x86-64
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2,fma,f16c"))),       \
+                             apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2,fma,f16c")
+#endif
+namespace avx2 {
+struct Ops {
+  using V = __m256d;
+  static constexpr int W = 4;
+  static V zero() { return _mm256_setzero_pd(); }
+  static V set1(const double x) { return _mm256_set1_pd(x); }
+  static V load(const double *p) { return _mm256_loadu_pd(p); }
+  static void store(double *p, const V v) { _mm256_storeu_pd(p, v); }
+  static V add(const V a, const V b) { return _mm256_add_pd(a, b); }
+  static V sub(const V a, const V b) { return _mm256_sub_pd(a, b); }
+  static V mul(const V a, const V b) { return _mm256_mul_pd(a, b); }
+  static V fma(const V a, const V b, const V c) {
+    return _mm256_fmadd_pd(a, b, c);
+  }
+  static double sum(const V v) {
+    const __m128d s =
+        _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+  }
+  static V gather(const double *p, const int *index) {
+    // Masked form, the plain one trips uninitialized warnings
+    return _mm256_mask_i32gather_pd(
+        _mm256_setzero_pd(), p,
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(index)),
+        _mm256_castsi256_pd(_mm256_set1_epi64x(-1)), 8);
+  }
+  using VI = __m256i;
+  static constexpr int NI = 8;
+  static VI zeroI() { return _mm256_setzero_si256(); }
+  static VI loadPairs(const int8_t *p) {
+    return _mm256_cvtepi8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+  }
+  static VI pair(const int16_t a, const int16_t b) {
+    return _mm256_set1_epi32(static_cast<uint16_t>(a) | b << 16);
+  }
+  static VI madd(const VI a, const VI b, const VI acc) {
+    return _mm256_add_epi32(acc, _mm256_madd_epi16(a, b));
+  }
+  static void storeI(int32_t *p, const VI v) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v);
+  }
+  using VF = __m256;
+  static constexpr int NF = 8;
+  static VF set1F(const float x) { return _mm256_set1_ps(x); }
+  static VF loadF(const float *p) { return _mm256_loadu_ps(p); }
+  static void storeF(float *p, const VF v) { _mm256_storeu_ps(p, v); }
+  static VF fmaF(const VF a, const VF b, const VF c) {
+    return _mm256_fmadd_ps(a, b, c);
+  }
+  template <HalfFormat F> static VF loadHalf(const uint16_t *p) {
+    const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    if constexpr (F == HalfFormat::BF16)
+      return _mm256_castsi256_ps(
+          _mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16));
+    return _mm256_cvtph_ps(h);
+  }
+  template <HalfFormat F> static void storeHalf(uint16_t *p, const VF v) {
+    __m128i h;
+    if constexpr (F == HalfFormat::FP16) {
+      h = _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT);
+    } else {
+      // Same steps as floatToHalf
+      const __m256i bits = _mm256_castps_si256(v);
+      const __m256i high = _mm256_srli_epi32(bits, 16);
+      const __m256i rounded = _mm256_srli_epi32(
+          _mm256_add_epi32(
+              _mm256_add_epi32(bits, _mm256_set1_epi32(0x7fff)),
+              _mm256_and_si256(high, _mm256_set1_epi32(1))),
+          16);
+      const __m256i r = _mm256_blendv_epi8(
+          rounded, _mm256_or_si256(high, _mm256_set1_epi32(0x40)),
+          _mm256_castps_si256(_mm256_cmp_ps(v, v, _CMP_UNORD_Q)));
+      // The packing works within each 128 bits half, then the halves meet
+      h = _mm256_castsi256_si128(
+          _mm256_permute4x64_epi64(_mm256_packus_epi32(r, r), 0xd8));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p), h);
+  }
+};
+#include "kernels_impl.h"
+} // namespace avx2
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx512f,avx512bw"))),   \
+                             apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw")
+#endif
+namespace avx512 {
+struct Ops {
+  using V = __m512d;
+  static constexpr int W = 8;
+  static V zero() { return _mm512_setzero_pd(); }
+  static V set1(const double x) { return _mm512_set1_pd(x); }
+  static V load(const double *p) { return _mm512_loadu_pd(p); }
+  static void store(double *p, const V v) { _mm512_storeu_pd(p, v); }
+  static V add(const V a, const V b) { return _mm512_add_pd(a, b); }
+  static V sub(const V a, const V b) { return _mm512_sub_pd(a, b); }
+  static V mul(const V a, const V b) { return _mm512_mul_pd(a, b); }
+  static V fma(const V a, const V b, const V c) {
+    return _mm512_fmadd_pd(a, b, c);
+  }
+  static double sum(const V v) {
+    // Through memory, the 512 bits extracts trip uninitialized warnings
+    alignas(64) double t[W];
+    _mm512_store_pd(t, v);
+    return ((t[0] + t[4]) + (t[2] + t[6])) + ((t[1] + t[5]) + (t[3] + t[7]));
+  }
+  static V gather(const double *p, const int *index) {
+    // Masked form, the plain one trips uninitialized warnings
+    return _mm512_mask_i32gather_pd(
+        _mm512_setzero_pd(), 0xff,
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(index)), p, 8);
+  }
+  using VI = __m512i;
+  static constexpr int NI = 16;
+  static VI zeroI() { return _mm512_setzero_si512(); }
+  static VI loadPairs(const int8_t *p) {
+    return _mm512_cvtepi8_epi16(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)));
+  }
+  static VI pair(const int16_t a, const int16_t b) {
+    return _mm512_set1_epi32(static_cast<uint16_t>(a) | b << 16);
+  }
+  static VI madd(const VI a, const VI b, const VI acc) {
+    return _mm512_add_epi32(acc, _mm512_madd_epi16(a, b));
+  }
+  static void storeI(int32_t *p, const VI v) { _mm512_storeu_si512(p, v); }
+  using VF = __m512;
+  static constexpr int NF = 16;
+  static VF set1F(const float x) { return _mm512_set1_ps(x); }
+  static VF loadF(const float *p) { return _mm512_loadu_ps(p); }
+  static void storeF(float *p, const VF v) { _mm512_storeu_ps(p, v); }
+  static VF fmaF(const VF a, const VF b, const VF c) {
+    return _mm512_fmadd_ps(a, b, c);
+  }
+  // Masked forms of the conversions and shifts, the plain ones trip
+  // uninitialized warnings
+  static constexpr __mmask16 ALL = 0xffff;
+  template <HalfFormat F> static VF loadHalf(const uint16_t *p) {
+    const __m256i h =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    if constexpr (F == HalfFormat::BF16)
+      return _mm512_castsi512_ps(_mm512_maskz_slli_epi32(
+          ALL, _mm512_maskz_cvtepu16_epi32(ALL, h), 16));
+    return _mm512_maskz_cvtph_ps(ALL, h);
+  }
+  template <HalfFormat F> static void storeHalf(uint16_t *p, const VF v) {
+    __m256i h;
+    if constexpr (F == HalfFormat::FP16) {
+      h = _mm512_maskz_cvtps_ph(ALL, v,
+                                _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    } else {
+      // Same steps as floatToHalf
+      const __m512i bits = _mm512_castps_si512(v);
+      const __m512i high = _mm512_maskz_srli_epi32(ALL, bits, 16);
+      const __m512i rounded = _mm512_maskz_srli_epi32(
+          ALL,
+          _mm512_add_epi32(
+              _mm512_add_epi32(bits, _mm512_set1_epi32(0x7fff)),
+              _mm512_and_si512(high, _mm512_set1_epi32(1))),
+          16);
+      h = _mm512_maskz_cvtepi32_epi16(
+          ALL, _mm512_mask_blend_epi32(
+                   _mm512_cmp_ps_mask(v, v, _CMP_UNORD_Q), rounded,
+                   _mm512_or_si512(high, _mm512_set1_epi32(0x40))));
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), h);
+  }
+};
+#include "kernels_impl.h"
+} // namespace avx512
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+#endif
+
+// DISPATCH
+using GemvFn = void (*)(int, int, const double *, const double *,
+                        const double *, double *);
+using GemvTransposedFn = void (*)(int, int, const double *, const double *,
+                                  double *);
+using OuterProductFn = void (*)(int, int, const double *, const double *,
+                                double *);
+using GemmFn = void (*)(int, int, int, const double *, const double *,
+                        const double *, double *);
+using SinCosFn = void (*)(int, const double *, double *, double *);
+using SparseGemvFn = void (*)(int, const int *, const int *, const double *,
+                              const double *, const double *, double *);
+using GemvInt8Fn = void (*)(int, int, const int8_t *, const int16_t *,
+                            int32_t *);
+using ToHalfFn = void (*)(HalfFormat, int, const float *, uint16_t *);
+using FromHalfFn = void (*)(HalfFormat, int, const uint16_t *, float *);
+using GemvHalfTransposedFn = void (*)(HalfFormat, int, int,
+                                      const uint16_t *, const uint16_t *,
+                                      const float *, float *);
+
+struct KernelTable {
+  SimdLevel level;
+  GemvFn gemv;
+  GemvTransposedFn gemvTransposed;
+  OuterProductFn outerProduct;
+  GemmFn gemm;
+  SinCosFn sinCos;
+  SparseGemvFn sparseGemv;
+  GemvInt8Fn gemvInt8;
+  ToHalfFn toHalf;
+  FromHalfFn fromHalf;
+  GemvHalfTransposedFn gemvHalfTransposed;
+};
+
+template <class Kernels>
+constexpr KernelTable tableOf(const SimdLevel level) {
+  return {level, &Kernels::gemv, &Kernels::gemvTransposed,
+          &Kernels::outerProduct, &Kernels::gemm, &Kernels::sinCos,
+          &Kernels::sparseGemv,
+          &Kernels::gemvInt8, &Kernels::toHalf, &Kernels::fromHalf,
+          &Kernels::gemvHalfTransposed};
+}
+
+const KernelTable &tableFor(const SimdLevel level) {
+  static constexpr KernelTable scalarTable =
+      tableOf<scalar::Kernels>(SimdLevel::Scalar);
+#if defined(ML_KERNELS_DISPATCH)
+  static constexpr KernelTable sse2Table =
+      tableOf<sse2::Kernels>(SimdLevel::SSE2);
+  static constexpr KernelTable avx2Table =
+      tableOf<avx2::Kernels>(SimdLevel::AVX2);
+  static constexpr KernelTable avx512Table =
+      tableOf<avx512::Kernels>(SimdLevel::AVX512);
+  switch (level) {
+  case SimdLevel::SSE2:
+    return sse2Table;
+  case SimdLevel::AVX2:
+    return avx2Table;
+  case SimdLevel::AVX512:
+    return avx512Table;
+  default:
+    break;
+  }
+#endif
+  return scalarTable;
+}
+
+SimdLevel bestSupported() {
+  for (const SimdLevel level :
+       {SimdLevel::AVX512, SimdLevel::AVX2, SimdLevel::SSE2})
+    if (isSupported(level))
+      return level;
+  return SimdLevel::Scalar;
+}
+
+// Looked up on each call, the cpu is probed once
+std::atomic<const KernelTable *> &currentTable() {
+  static std::atomic<const KernelTable *> table = &tableFor(bestSupported());
+  return table;
+}
+
+} // namespace
+
+bool isSupported(const SimdLevel level) {
+  switch (level) {
+  case SimdLevel::Scalar:
+    return true;
+#if defined(ML_KERNELS_DISPATCH)
+  case SimdLevel::SSE2:
+    return true;
+  case SimdLevel::AVX2:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+           __builtin_cpu_supports("f16c");
+  case SimdLevel::AVX512:
+    __builtin_cpu_init();
+    // The integer kernels need the byte and word instructions
+    return __builtin_cpu_supports("avx512f") &&
+           __builtin_cpu_supports("avx512bw");
+#endif
+  default:
+    return false;
+  }
+}
+
+SimdLevel simdLevel() { return currentTable().load()->level; }
+
+void setSimdLevel(const SimdLevel level) {
+  assert(isSupported(level) && "ERROR: instruction set not supported");
+  currentTable().store(&tableFor(level));
+}
+
+const char *simdLevelName(const SimdLevel level) {
+  switch (level) {
+  case SimdLevel::Scalar:
+    return "Scalar";
+  case SimdLevel::SSE2:
+    return "SSE2";
+  case SimdLevel::AVX2:
+    return "AVX2";
+  case SimdLevel::AVX512:
+    return "AVX-512";
+  }
+  return "Scalar";
+}
+
+void gemv(const int m, const int n, const double *a, const double *x,
+          const double *bias, double *y) {
+  currentTable().load()->gemv(m, n, a, x, bias, y);
+}
+void gemvTransposed(const int m, const int n, const double *a,
+                    const double *x, double *y) {
+  currentTable().load()->gemvTransposed(m, n, a, x, y);
+}
+void outerProduct(const int m, const int n, const double *x, const double *y,
+                  double *a) {
+  currentTable().load()->outerProduct(m, n, x, y, a);
+}
+void gemm(const int m, const int n, const int k, const double *a,
+          const double *b, const double *bias, double *c) {
+  currentTable().load()->gemm(m, n, k, a, b, bias, c);
+}
+void sinCos(const int n, const double *x, double *s, double *c) {
+  currentTable().load()->sinCos(n, x, s, c);
+}
+void sparseGemv(const int m, const int *offsets, const int *columns,
+                const double *values, const double *x, const double *bias,
+                double *y) {
+  currentTable().load()->sparseGemv(m, offsets, columns, values, x, bias, y);
+}
+
+int packedInt8Size(const int m, const int n) {
+  return int8Rows(m) * ((n + 1) / 2 * 2);
+}
+void packInt8(const int m, const int n, const int8_t *a, int8_t *packed) {
+  const int rows = int8Rows(m);
+  std::fill(packed, packed + packedInt8Size(m, n), 0);
+  for (int j = 0; j < m; ++j)
+    for (int k = 0; k < n; ++k)
+      packed[(k / 2 * rows + j) * 2 + k % 2] = a[j * n + k];
+}
+void gemvInt8(const int m, const int n, const int8_t *packed,
+              const int16_t *x, int32_t *y) {
+  currentTable().load()->gemvInt8(m, n, packed, x, y);
+}
+
+uint16_t toHalf(const HalfFormat format, const float x) {
+  return format == HalfFormat::FP16 ? floatToHalf<HalfFormat::FP16>(x)
+                                    : floatToHalf<HalfFormat::BF16>(x);
+}
+float fromHalf(const HalfFormat format, const uint16_t h) {
+  return format == HalfFormat::FP16 ? halfToFloat<HalfFormat::FP16>(h)
+                                    : halfToFloat<HalfFormat::BF16>(h);
+}
+void toHalf(const HalfFormat format, const int n, const float *x,
+            uint16_t *h) {
+  currentTable().load()->toHalf(format, n, x, h);
+}
+void fromHalf(const HalfFormat format, const int n, const uint16_t *h,
+              float *x) {
+  currentTable().load()->fromHalf(format, n, h, x);
+}
+void gemvHalfTransposed(const HalfFormat format, const int m, const int n,
+                        const uint16_t *a, const uint16_t *x,
+                        const float *bias, float *y) {
+  currentTable().load()->gemvHalfTransposed(format, m, n, a, x, bias, y);
+}
+
+} // namespace ml
@@ -0,0 +1,383 @@
+// Kernels written once against the vector operations of an instruction set.
+// Included once per instruction set, inside a namespace that defines Ops and
+// with that instruction set enabled: no include guard.
+
+struct Kernels {
+  using V = Ops::V;
+  static constexpr int W = Ops::W;
+  using VI = Ops::VI;
+  static constexpr int NI = Ops::NI;
+  using VF = Ops::VF;
+  static constexpr int NF = Ops::NF;
+  // Register block: rows sharing the loads of the other operand
+  static constexpr int MR = 4;
+  static constexpr int NR = 2 * W;
+  // Cache block of b for gemm, packed into 32KB
+  static constexpr int KC = 128;
+  static constexpr int NC = 32;
+
+  template <int R>
+  static void gemvRows(const int n, const double *a, const double *x,
+                       const double *bias, double *y) {
+    V acc[R];
+    for (V &v : acc)
+      v = Ops::zero();
+    int i = 0;
+    for (; i + W <= n; i += W) {
+      const V xv = Ops::load(x + i);
+#pragma GCC unroll 8
+      for (int r = 0; r < R; ++r)
+        acc[r] = Ops::fma(Ops::load(a + r * n + i), xv, acc[r]);
+    }
+    for (int r = 0; r < R; ++r) {
+      double s = Ops::sum(acc[r]);
+      for (int t = i; t < n; ++t)
+        s += a[r * n + t] * x[t];
+      y[r] = s + (bias ? bias[r] : 0.0);
+    }
+  }
+
+  static void gemv(const int m, const int n, const double *a,
+                   const double *x, const double *bias, double *y) {
+    int j = 0;
+    for (; j + MR <= m; j += MR)
+      gemvRows<MR>(n, a + j * n, x, bias ? bias + j : nullptr, y + j);
+    for (; j < m; ++j)
+      gemvRows<1>(n, a + j * n, x, bias ? bias + j : nullptr, y + j);
+  }
+
+  // Each lane sums one row of the slice, against the inputs gathered from
+  // its columns
+  static void sparseGemv(const int m, const int *offsets, const int *columns,
+                         const double *values, const double *x,
+                         const double *bias, double *y) {
+    constexpr int R = SPARSE_SLICE / W;
+    for (int j = 0, s = 0; j < m; j += SPARSE_SLICE, ++s) {
+      V acc[R];
+      for (V &v : acc)
+        v = Ops::zero();
+      for (int p = offsets[s]; p < offsets[s + 1]; p += SPARSE_SLICE)
+#pragma GCC unroll 8
+        for (int r = 0; r < R; ++r)
+          acc[r] = Ops::fma(Ops::load(values + p + r * W),
+                            Ops::gather(x, columns + p + r * W), acc[r]);
+      double out[SPARSE_SLICE];
+      for (int r = 0; r < R; ++r)
+        Ops::store(out + r * W, acc[r]);
+      for (int t = 0; t < SPARSE_SLICE && j + t < m; ++t)
+        y[j + t] = out[t] + (bias ? bias[j + t] : 0.0);
+    }
+  }
+
+  template <int R>
+  static void axpyRows(const int n, const double *a, const double *x,
+                       double *y) {
+    V xs[R];
+    for (int r = 0; r < R; ++r)
+      xs[r] = Ops::set1(x[r]);
+    int i = 0;
+    for (; i + W <= n; i += W) {
+      V acc = Ops::load(y + i);
+#pragma GCC unroll 8
+      for (int r = 0; r < R; ++r)
+        acc = Ops::fma(xs[r], Ops::load(a + r * n + i), acc);
+      Ops::store(y + i, acc);
+    }
+    for (; i < n; ++i)
+      for (int r = 0; r < R; ++r)
+        y[i] += x[r] * a[r * n + i];
+  }
+
+  static void gemvTransposed(const int m, const int n, const double *a,
+                             const double *x, double *y) {
+    std::fill(y, y + n, 0.0);
+    int j = 0;
+    for (; j + MR <= m; j += MR)
+      axpyRows<MR>(n, a + j * n, x + j, y);
+    for (; j < m; ++j)
+      axpyRows<1>(n, a + j * n, x + j, y);
+  }
+
+  static void outerProduct(const int m, const int n, const double *x,
+                           const double *y, double *a) {
+    for (int j = 0; j < m; ++j) {
+      const V xv = Ops::set1(x[j]);
+      double *row = a + j * n;
+      int i = 0;
+      for (; i + W <= n; i += W)
+        Ops::store(row + i, Ops::mul(xv, Ops::load(y + i)));
+      for (; i < n; ++i)
+        row[i] = x[j] * y[i];
+    }
+  }
+
+  // MR rows of a times NR packed columns of b, added to c or to the bias
+  static void microKernel(const int mr, const int nr, const int kc,
+                          const double *a, const int lda,
+                          const double *packed, const int ldp,
+                          const double *bias, const bool first, double *c,
+                          const int ldc) {
+    V acc[MR][2];
+    for (auto &row : acc)
+      row[0] = row[1] = Ops::zero();
+    // Missing rows repeat the last one, their results are dropped
+    const double *rows[MR];
+    for (int r = 0; r < MR; ++r)
+      rows[r] = a + std::min(r, mr - 1) * lda;
+    for (int p = 0; p < kc; ++p) {
+      const V b0 = Ops::load(packed + p * ldp);
+      const V b1 = Ops::load(packed + p * ldp + W);
+      // Unrolled so the accumulators stay in registers
+#pragma GCC unroll 8
+      for (int r = 0; r < MR; ++r) {
+        const V av = Ops::set1(rows[r][p]);
+        acc[r][0] = Ops::fma(av, b0, acc[r][0]);
+        acc[r][1] = Ops::fma(av, b1, acc[r][1]);
+      }
+    }
+    if (nr == NR) {
+      for (int r = 0; r < mr; ++r)
+        for (int h = 0; h < 2; ++h) {
+          double *v = c + r * ldc + h * W;
+          const V base = !first ? Ops::load(v)
+                         : bias ? Ops::load(bias + h * W)
+                                : Ops::zero();
+          Ops::store(v, Ops::add(base, acc[r][h]));
+        }
+      return;
+    }
+    double out[MR][NR];
+    for (int r = 0; r < MR; ++r) {
+      Ops::store(out[r], acc[r][0]);
+      Ops::store(out[r] + W, acc[r][1]);
+    }
+    for (int r = 0; r < mr; ++r)
+      for (int t = 0; t < nr; ++t) {
+        double &v = c[r * ldc + t];
+        v = (first ? (bias ? bias[t] : 0.0) : v) + out[r][t];
+      }
+  }
+
+  static void gemm(const int m, const int n, const int k, const double *a,
+                   const double *b, const double *bias, double *c) {
+    if (k == 0) {
+      for (int s = 0; s < m; ++s)
+        for (int j = 0; j < n; ++j)
+          c[s * n + j] = bias ? bias[j] : 0.0;
+      return;
+    }
+    // Too narrow for the register block, one dot product per output instead
+    if (n < NR) {
+      for (int s = 0; s < m; ++s)
+        gemv(n, k, b, a + s * k, bias, c + s * n);
+      return;
+    }
+    alignas(64) double packed[KC * NC];
+    for (int jc = 0; jc < n; jc += NC) {
+      const int nc = std::min(NC, n - jc);
+      const int ncPad = (nc + NR - 1) / NR * NR;
+      for (int pc = 0; pc < k; pc += KC) {
+        const int kc = std::min(KC, k - pc);
+        // Tile of b transposed, padded with zeros to whole registers
+        for (int p = 0; p < kc; ++p)
+          for (int jj = 0; jj < ncPad; ++jj)
+            packed[p * ncPad + jj] =
+                jj < nc ? b[(jc + jj) * k + pc + p] : 0.0;
+        for (int s = 0; s < m; s += MR)
+          for (int jj = 0; jj < ncPad; jj += NR)
+            microKernel(std::min(MR, m - s), std::min(NR, nc - jj), kc,
+                        a + s * k + pc, k, packed + jj, ncPad,
+                        bias ? bias + jc + jj : nullptr, pc == 0,
+                        c + s * n + jc + jj, n);
+      }
+    }
+  }
+
+  // R registers of outputs, each int32 lane gets the products of its pair
+  // of weights with the broadcast pair of inputs
+  template <int R>
+  static void gemvInt8Block(const int m, const int n, const int rows,
+                            const int8_t *packed, const int16_t *x,
+                            int32_t *y) {
+    VI acc[R];
+    for (VI &v : acc)
+      v = Ops::zeroI();
+    for (int k = 0; k < n; k += 2) {
+      const VI xv = Ops::pair(x[k], k + 1 < n ? x[k + 1] : 0);
+      const int8_t *w = packed + k * rows;
+#pragma GCC unroll 8
+      for (int r = 0; r < R; ++r)
+        acc[r] = Ops::madd(Ops::loadPairs(w + 2 * NI * r), xv, acc[r]);
+    }
+    for (int r = 0; r < R; ++r) {
+      if ((r + 1) * NI <= m) {
+        Ops::storeI(y + r * NI, acc[r]);
+        continue;
+      }
+      int32_t out[NI];
+      Ops::storeI(out, acc[r]);
+      for (int t = 0; r * NI + t < m; ++t)
+        y[r * NI + t] = out[t];
+    }
+  }
+
+  static void gemvInt8(const int m, const int n, const int8_t *packed,
+                       const int16_t *x, int32_t *y) {
+    const int rows = int8Rows(m);
+    const int end = (m + NI - 1) / NI * NI;
+    int j = 0;
+    for (; j + MR * NI <= end; j += MR * NI)
+      gemvInt8Block<MR>(m - j, n, rows, packed + 2 * j, x, y + j);
+    for (; j < end; j += NI)
+      gemvInt8Block<1>(m - j, n, rows, packed + 2 * j, x, y + j);
+  }
+
+  // R registers of outputs, each input broadcast against its row of a
+  template <HalfFormat F, int R>
+  static void gemvHalfBlock(const int m, const int n, const uint16_t *a,
+                            const float *x, float *y) {
+    VF acc[R];
+    for (int r = 0; r < R; ++r)
+      acc[r] = Ops::loadF(y + r * NF);
+    for (int k = 0; k < m; ++k) {
+      const VF xv = Ops::set1F(x[k]);
+#pragma GCC unroll 8
+      for (int r = 0; r < R; ++r)
+        acc[r] = Ops::fmaF(xv, Ops::loadHalf<F>(a + k * n + r * NF), acc[r]);
+    }
+    for (int r = 0; r < R; ++r)
+      Ops::storeF(y + r * NF, acc[r]);
+  }
+
+  template <HalfFormat F>
+  static void gemvHalfTransposedAs(const int m, const int n,
+                                   const uint16_t *a, const uint16_t *x,
+                                   const float *bias, float *y) {
+    for (int j = 0; j < n; ++j)
+      y[j] = bias ? bias[j] : 0.0f;
+    // x widened once per chunk of rows
+    alignas(64) float xs[KC];
+    for (int kc = 0; kc < m; kc += KC) {
+      const int kb = std::min(KC, m - kc);
+      fromHalfAs<F>(kb, x + kc, xs);
+      const uint16_t *rows = a + kc * n;
+      int j = 0;
+      for (; j + MR * NF <= n; j += MR * NF)
+        gemvHalfBlock<F, MR>(kb, n, rows + j, xs, y + j);
+      for (; j + NF <= n; j += NF)
+        gemvHalfBlock<F, 1>(kb, n, rows + j, xs, y + j);
+      for (; j < n; ++j) {
+        float s = y[j];
+        for (int k = 0; k < kb; ++k)
+          s += xs[k] * halfToFloat<F>(rows[k * n + j]);
+        y[j] = s;
+      }
+    }
+  }
+
+  static void gemvHalfTransposed(const HalfFormat format, const int m,
+                                 const int n, const uint16_t *a,
+                                 const uint16_t *x, const float *bias,
+                                 float *y) {
+    if (format == HalfFormat::FP16)
+      gemvHalfTransposedAs<HalfFormat::FP16>(m, n, a, x, bias, y);
+    else
+      gemvHalfTransposedAs<HalfFormat::BF16>(m, n, a, x, bias, y);
+  }
+
+  template <HalfFormat F>
+  static void toHalfAs(const int n, const float *x, uint16_t *h) {
+    int i = 0;
+    for (; i + NF <= n; i += NF)
+      Ops::storeHalf<F>(h + i, Ops::loadF(x + i));
+    for (; i < n; ++i)
+      h[i] = floatToHalf<F>(x[i]);
+  }
+
+  static void toHalf(const HalfFormat format, const int n, const float *x,
+                     uint16_t *h) {
+    if (format == HalfFormat::FP16)
+      toHalfAs<HalfFormat::FP16>(n, x, h);
+    else
+      toHalfAs<HalfFormat::BF16>(n, x, h);
+  }
+
+  template <HalfFormat F>
+  static void fromHalfAs(const int n, const uint16_t *h, float *x) {
+    int i = 0;
+    for (; i + NF <= n; i += NF)
+      Ops::storeF(x + i, Ops::loadHalf<F>(h + i));
+    for (; i < n; ++i)
+      x[i] = halfToFloat<F>(h[i]);
+  }
+
+  static void fromHalf(const HalfFormat format, const int n,
+                       const uint16_t *h, float *x) {
+    if (format == HalfFormat::FP16)
+      fromHalfAs<HalfFormat::FP16>(n, h, x);
+    else
+      fromHalfAs<HalfFormat::BF16>(n, h, x);
+  }
+
+  // Taylor polynomials of the half angle, in [-pi/2, pi/2] after reduction
+  static void sinCosV(const V x, V &s, V &c) {
+    // Adding then removing 1.5 * 2^52 rounds to the nearest integer
+    const V shift = Ops::set1(6755399441055744.0);
+    const V k = Ops::sub(
+        Ops::add(Ops::mul(x, Ops::set1(0.15915494309189535)), shift), shift);
+    // 2pi in two parts so that the reduction stays exact
+    V r = Ops::fma(k, Ops::set1(-6.283185307179586), x);
+    r = Ops::fma(k, Ops::set1(-2.4492935982947064e-16), r);
+    const V h = Ops::mul(r, Ops::set1(0.5));
+    const V h2 = Ops::mul(h, h);
+    V sh = Ops::set1(1.0 / 355687428096000.0);
+    sh = Ops::fma(sh, h2, Ops::set1(-1.0 / 1307674368000.0));
+    sh = Ops::fma(sh, h2, Ops::set1(1.0 / 6227020800.0));
+    sh = Ops::fma(sh, h2, Ops::set1(-1.0 / 39916800.0));
+    sh = Ops::fma(sh, h2, Ops::set1(1.0 / 362880.0));
+    sh = Ops::fma(sh, h2, Ops::set1(-1.0 / 5040.0));
+    sh = Ops::fma(sh, h2, Ops::set1(1.0 / 120.0));
+    sh = Ops::fma(sh, h2, Ops::set1(-1.0 / 6.0));
+    sh = Ops::fma(Ops::mul(sh, h2), h, h);
+    V ch = Ops::set1(1.0 / 6402373705728000.0);
+    ch = Ops::fma(ch, h2, Ops::set1(-1.0 / 20922789888000.0));
+    ch = Ops::fma(ch, h2, Ops::set1(1.0 / 87178291200.0));
+    ch = Ops::fma(ch, h2, Ops::set1(-1.0 / 479001600.0));
+    ch = Ops::fma(ch, h2, Ops::set1(1.0 / 3628800.0));
+    ch = Ops::fma(ch, h2, Ops::set1(-1.0 / 40320.0));
+    ch = Ops::fma(ch, h2, Ops::set1(1.0 / 720.0));
+    ch = Ops::fma(ch, h2, Ops::set1(-1.0 / 24.0));
+    ch = Ops::fma(ch, h2, Ops::set1(0.5));
+    ch = Ops::fma(Ops::mul(ch, h2), Ops::set1(-1.0), Ops::set1(1.0));
+    // Double angle
+    s = Ops::mul(Ops::set1(2.0), Ops::mul(sh, ch));
+    c = Ops::mul(Ops::sub(ch, sh), Ops::add(ch, sh));
+  }
+
+  static void sinCos(const int n, const double *x, double *s, double *c) {
+    V sv, cv;
+    int i = 0;
+    for (; i + W <= n; i += W) {
+      sinCosV(Ops::load(x + i), sv, cv);
+      if (s)
+        Ops::store(s + i, sv);
+      if (c)
+        Ops::store(c + i, cv);
+    }
+    if (i == n)
+      return;
+    // The tail goes through a full register
+    double in[W] = {}, outS[W], outC[W];
+    for (int t = 0; i + t < n; ++t)
+      in[t] = x[i + t];
+    sinCosV(Ops::load(in), sv, cv);
+    Ops::store(outS, sv);
+    Ops::store(outC, cv);
+    for (int t = 0; i + t < n; ++t) {
+      if (s)
+        s[i + t] = outS[t];
+      if (c)
+        c[i + t] = outC[t];
+    }
+  }
+};
@@ -1,98 +1,171 @@
 #include "libml/compute/nodes.h"
 #include "libml/compute/graph.h"
+#include "libml/compute/kernels.h"
+#include "libml/compute/reduce.h"
 
+#include <cassert>
 #include <cmath>
+#include <deque>
+#include <mutex>
 #include <ranges>
+#include <unordered_map>
 
 namespace ml {
 
 // SLOTS
-int Slots::get(ComputeNode &node) { return _inputIndices[&node]; }
+int Slots::get(ComputeNode &node) {
+  return static_cast<int>(std::ranges::find(_inputs, &node) - _inputs.begin());
+}
 
 ComputeNode &Slots::get(const int index) { return *_inputs[index]; }
 
 void Slots::set(const int index, ComputeNode &node) {
+  if (index >= _inputs.size())
+    _inputs.resize(index + 1, nullptr);
   _inputs[index] = &node;
-  _inputIndices[&node] = index;
 }
 
 void Slots::erase(ComputeNode &node) {
-  const int index = _inputIndices[&node];
-  _inputIndices.erase(&node);
-  _inputs.erase(index);
+  const auto it = std::ranges::find(_inputs, &node);
+  if (it != _inputs.end())
+    *it = nullptr;
+  _trim();
 }
 
 void Slots::erase(const int index) {
-  ComputeNode *node = _inputs[index];
-  _inputs.erase(index);
-  _inputIndices.erase(node);
+  _inputs[index] = nullptr;
+  _trim();
 }
 
-int Slots::size() const { return static_cast<int>(_inputs.size()); }
-std::vector<ComputeNode *> Slots::getNodes() {
-  auto v = std::ranges::views::values(_inputs);
-  return {v.begin(), v.end()};
+void Slots::_trim() {
+  while (!_inputs.empty() && _inputs.back() == nullptr)
+    _inputs.pop_back();
 }
-std::vector<int> Slots::getIndices() {
-  auto v = std::ranges::views::keys(_inputs);
-  return {v.begin(), v.end()};
+
+int Slots::size() const { return static_cast<int>(_inputs.size()); }
+bool Slots::contains(const int index) const {
+  return index >= 0 && index < _inputs.size() && _inputs[index];
+}
+
+// LABELS
+namespace {
+struct LabelStorage {
+  std::mutex mutex;
+  // A deque never moves its elements, handed out references stay valid
+  std::deque<std::string> labels = {""};
+  std::unordered_map<std::string, uint32_t> handles = {{"", 0}};
+};
+LabelStorage &labelStorage() {
+  static LabelStorage storage;
+  return storage;
+}
+} // namespace
+
+uint32_t LabelTable::intern(const std::string &label) {
+  if (label.empty())
+    return EMPTY;
+  LabelStorage &s = labelStorage();
+  std::lock_guard lock(s.mutex);
+  const auto [it, inserted] =
+      s.handles.try_emplace(label, static_cast<uint32_t>(s.labels.size()));
+  if (inserted)
+    s.labels.push_back(label);
+  return it->second;
+}
+
+const std::string &LabelTable::get(const uint32_t handle) {
+  LabelStorage &s = labelStorage();
+  std::lock_guard lock(s.mutex);
+  return s.labels[handle];
 }
 
 // BASE
+namespace {
+// Inputs are evaluated before the gather, nested reductions can then reuse
+// the same scratch buffer instead of keeping one per node
+const std::vector<double> &gatherInputs(ComputeNode &node) {
+  thread_local std::vector<double> scratch;
+  const int n = node.nbInputs();
+  for (int i = 0; i < n; ++i)
+    node.inputAt(i).eval();
+  scratch.resize(n);
+  for (int i = 0; i < n; ++i)
+    scratch[i] = node.inputAt(i).eval();
+  return scratch;
+}
+} // namespace
 
 ComputeNode::ComputeNode(const uint32_t id) : _id(id) {}
 std::string ComputeNode::label() { return "UNKNOWN"; }
-int ComputeNode::incOwnerCount() { return ++_ownerCount; };
-int ComputeNode::decOwnerCount() { return --_ownerCount; };
-int ComputeNode::ownerCount() { return _ownerCount; };
-uint32_t ComputeNode::id() { return _id; }
+uint32_t ComputeNode::id() {
+  assert(_id != UINT32_MAX && "ERROR: node id read before its block merged");
+  return _id;
+}
+double ComputeNode::cachedEval() const { return _cachedEval; }
 
 double ComputeNode::eval() {
-  if (_invalidateCache)
+  if (_flags & INVALIDATE_CACHE)
     _clearCache();
 
-  if (_cachedEval.has_value())
-    return _cachedEval.value();
+  if (_flags & HAS_EVAL)
+    return _cachedEval;
 
   const double r = _eval();
   _cachedEval = r;
+  _flags |= HAS_EVAL;
   return r;
 }
 
 double ComputeNode::diff() {
-  if (_invalidateCache)
+  if (_flags & INVALIDATE_CACHE)
     _clearCache();
 
-  if (_cachedGradient.has_value())
-    return _cachedGradient.value();
-
-  // The last node of the graph structure is always one
-  double g = _outputs.empty() ? 1.0 : 0.0;
-  for (const auto &_output : _outputs) {
-    const double v =
-        _output->diff() * _output->pdiff(_output->_slots.get(*this));
-    g += v;
+  if (_flags & HAS_GRADIENT)
+    return _cachedGradient;
+
+  // The last node of the graph structure is always one. Symbolic gradients
+  // read the forward nodes without being part of what they compute.
+  double g = 0.0;
+  bool isLast = true;
+  for (const auto &[output, slot] : _outputs) {
+    if (output->_flags & SYMBOLIC)
+      continue;
+    isLast = false;
+    // Partials come from the value and operands kept by the forward pass
+    assert((output->_flags & HAS_EVAL) &&
+           !(output->_flags & INVALIDATE_CACHE) &&
+           "ERROR: diff() before the forward pass reached the node outputs");
+    // A zero partial, like an inactive ReLU, adds nothing: the gradient of
+    // that output is not pulled for it, but still is by any other path. The
+    // optimizers skip whole cones in CompactGraph::backward() instead.
+    const double p = output->pdiff(slot);
+    if (p == 0.0)
+      continue;
+    g += output->diff() * p;
   }
+  if (isLast)
+    g = 1.0;
 
   _cachedGradient = g;
-  return _cachedGradient.value();
+  _flags |= HAS_GRADIENT;
+  return _cachedGradient;
 }
 
 void ComputeNode::invalidateCache() {
-  if (!_invalidateCache) {
-    _invalidateCache = true;
+  if (!(_flags & INVALIDATE_CACHE)) {
+    _flags |= INVALIDATE_CACHE;
 
     // propagate request to its outputs and inputs
-    for (const auto n : _outputs)
-      n->invalidateCache();
+    for (const auto &o : _outputs)
+      o.node->invalidateCache();
     for (int i = 0; i < _slots.size(); ++i)
       _slots.get(i).invalidateCache();
   }
 }
 
 int ComputeNode::connect(ComputeNode &other, const std::optional<int> &slot) {
-  _outputs.push_back(&other);
   int newSlot = slot.has_value() ? slot.value() : other._slots.size();
+  _outputs.push_back({&other, newSlot});
   other._slots.set(newSlot, *this);
   invalidateCache();
   return newSlot;
@@ -100,20 +173,21 @@ int ComputeNode::connect(ComputeNode &other, const std::optional<int> &slot) {
 
 void ComputeNode::disconnect(ComputeNode &other) {
   invalidateCache();
-  _outputs.erase(std::ranges::find(_outputs, &other));
-  other._slots.erase(*this);
+  const auto it = std::ranges::find(_outputs, &other, &Output::node);
+  // The slot is known, no need to search the inputs of the other node
+  other._slots.erase(it->slot);
+  _outputs.erase(it);
 }
 
+// Trailing empty slots are trimmed, so the last slot always holds a node
 void ComputeNode::clearInputs() {
-  const std::vector<ComputeNode *> tmp = _slots.getNodes();
-  for (ComputeNode *n : tmp)
-    n->disconnect(*this);
+  while (_slots.size() > 0)
+    _slots.get(_slots.size() - 1).disconnect(*this);
 }
 
 void ComputeNode::clearOutputs() {
-  const std::vector<ComputeNode *> tmp{_outputs.begin(), _outputs.end()};
-  for (ComputeNode *n : tmp)
-    disconnect(*n);
+  while (!_outputs.empty())
+    disconnect(*_outputs.back().node);
 }
 void ComputeNode::clearConnections() {
   clearInputs();
@@ -122,16 +196,15 @@ void ComputeNode::clearConnections() {
 
 ComputeNode &ComputeNode::inputAt(const int index) { return _slots.get(index); }
 ComputeNode &ComputeNode::outputAt(const int index) const {
-  return *_outputs[index];
+  return *_outputs[index].node;
+}
+bool ComputeNode::hasInput(const int index) const {
+  return _slots.contains(index);
 }
 int ComputeNode::nbOutputs() const { return static_cast<int>(_outputs.size()); }
 int ComputeNode::nbInputs() const { return _slots.size(); }
 
-void ComputeNode::_clearCache() {
-  _cachedEval = {};
-  _cachedGradient = {};
-  _invalidateCache = false;
-}
+void ComputeNode::_clearCache() { _flags &= SYMBOLIC; }
 
 // IDENTITY
 IdentityNode::IdentityNode(const uint32_t id) : ComputeNode(id) {}
@@ -158,21 +231,23 @@ ConstantNode::ConstantNode(const uint32_t id, const double value,
                            const std::string &label)
     : ComputeNode(id) {
   _value = value;
-  _label = label;
+  _label = LabelTable::intern(label);
 }
 std::string ConstantNode::label() {
-  if (_label.empty())
-    return _labelPrefix + std::to_string(_value);
-  return _labelPrefix + _label;
+  if (_label == LabelTable::EMPTY)
+    return LabelTable::get(_labelPrefix) + std::to_string(_value);
+  return LabelTable::get(_labelPrefix) + LabelTable::get(_label);
 }
 void ConstantNode::setLabelPrefix(const std::string &prefix) {
-  _labelPrefix = prefix;
+  _labelPrefix = LabelTable::intern(prefix);
 }
 void ConstantNode::set(const double value) {
   _value = value;
   invalidateCache();
 }
-void ConstantNode::setLabel(const std::string &label) { _label = label; }
+void ConstantNode::setLabel(const std::string &label) {
+  _label = LabelTable::intern(label);
+}
 double ConstantNode::_eval() { return _value; }
 double ConstantNode::pdiff(const int index) { return 0.0; }
 void ConstantNode::forwardVisit(ComputeNodeVisitor &v) {
@@ -194,17 +269,21 @@ void ConstantNode::backwardVisit(ComputeNodeVisitor &v) {
 MultNode::MultNode(const uint32_t id) : ComputeNode(id) {}
 std::string MultNode::label() { return "*"; }
 double MultNode::_eval() {
-  double r = inputAt(0).eval();
-  for (int i = 1; i < nbInputs(); ++i)
-    r *= inputAt(i).eval();
-  return r;
+  const int n = nbInputs();
+  _operands.resize(n);
+  for (int i = 0; i < n; ++i)
+    _operands[i] = inputAt(i).eval();
+  return reduceProduct(_operands.data(), n);
 }
 double MultNode::pdiff(const int index) {
-  double r = 1.0;
-  for (int i = 0; i < nbInputs(); ++i)
-    if (i != index)
-      r *= inputAt(i).eval();
-  return r;
+  // All partials are built at once from the gathered operands, so the
+  // backward pass stays linear in the fan-in
+  const int n = nbInputs();
+  if (_operands.size() == n) {
+    _operands.resize(2 * n);
+    reduceProductPartials(_operands.data(), n, _operands.data() + n);
+  }
+  return _operands[n + index];
 }
 void MultNode::forwardVisit(ComputeNodeVisitor &v) {
   bool skip = v.visit(*this);
@@ -249,12 +328,16 @@ void CteMultNode::backwardVisit(ComputeNodeVisitor &v) {
 // DIVISION
 DivideNode::DivideNode(const uint32_t id) : ComputeNode(id) {}
 std::string DivideNode::label() { return "/"; }
-double DivideNode::_eval() { return inputAt(0).eval() / inputAt(1).eval(); }
+double DivideNode::_eval() {
+  _operands[0] = inputAt(0).eval();
+  _operands[1] = inputAt(1).eval();
+  return _operands[0] / _operands[1];
+}
 double DivideNode::pdiff(const int index) {
-  const double x = inputAt(1).eval();
+  const double x = _operands[1];
   if (index == 0)
     return 1.0 / x;
-  return -inputAt(0).eval() / (x * x);
+  return -_operands[0] / (x * x);
 }
 void DivideNode::forwardVisit(ComputeNodeVisitor &v) {
   bool skip = v.visit(*this);
@@ -340,10 +423,8 @@ void UnarySubNode::backwardVisit(ComputeNodeVisitor &v) {
 AddNode::AddNode(const uint32_t id) : ComputeNode(id) {}
 std::string AddNode::label() { return "+"; }
 double AddNode::_eval() {
-  double r = 0.0;
-  for (int i = 0; i < nbInputs(); ++i)
-    r += inputAt(i).eval();
-  return r;
+  const std::vector<double> &operands = gatherInputs(*this);
+  return reduceSum(operands.data(), nbInputs());
 }
 double AddNode::pdiff(const int index) { return 1.0; }
 void AddNode::forwardVisit(ComputeNodeVisitor &v) {
@@ -365,9 +446,7 @@ void AddNode::backwardVisit(ComputeNodeVisitor &v) {
 ReLUNode::ReLUNode(const uint32_t id) : ComputeNode(id) {}
 std::string ReLUNode::label() { return "ReLU"; }
 double ReLUNode::_eval() { return std::max(0.0, inputAt(0).eval()); }
-double ReLUNode::pdiff(const int index) {
-  return inputAt(0).eval() <= 0 ? 0.0 : 1.0;
-}
+double ReLUNode::pdiff(const int index) { return cachedEval() > 0 ? 1.0 : 0.0; }
 void ReLUNode::forwardVisit(ComputeNodeVisitor &v) {
   bool skip = v.visit(*this);
   if (skip)
@@ -387,7 +466,7 @@ SigmoidNode::SigmoidNode(const uint32_t id) : ComputeNode(id) {}
 std::string SigmoidNode::label() { return "Sigmoid"; }
 double SigmoidNode::_eval() { return 1.0 / (1 + std::exp(-inputAt(0).eval())); }
 double SigmoidNode::pdiff(const int index) {
-  const double v = eval();
+  const double v = cachedEval();
   return v * (1.0 - v);
 }
 void SigmoidNode::forwardVisit(ComputeNodeVisitor &v) {
@@ -405,6 +484,32 @@ void SigmoidNode::backwardVisit(ComputeNodeVisitor &v) {
     inputAt(i).backwardVisit(v);
 }
 
+SineNode::SineNode(const uint32_t id, const double omega)
+    : ComputeNode(id), _omega(omega) {}
+std::string SineNode::label() { return "Sin"; }
+double SineNode::getOmega() const { return _omega; }
+double SineNode::_eval() {
+  const double x = _omega * inputAt(0).eval();
+  double s;
+  sinCos(1, &x, &s, &_cosine);
+  return s;
+}
+double SineNode::pdiff(const int index) { return _omega * _cosine; }
+void SineNode::forwardVisit(ComputeNodeVisitor &v) {
+  bool skip = v.visit(*this);
+  if (skip)
+    return;
+  for (int i = 0; i < nbOutputs(); ++i)
+    outputAt(i).forwardVisit(v);
+}
+void SineNode::backwardVisit(ComputeNodeVisitor &v) {
+  bool skip = v.visit(*this);
+  if (skip)
+    return;
+  for (int i = 0; i < nbInputs(); ++i)
+    inputAt(i).backwardVisit(v);
+}
+
 // POWER
 
 std::string CtePowerNode::label() { return "^" + std::to_string(_power); }
@@ -415,9 +520,12 @@ void CtePowerNode::setPower(const int power) {
   _power = power;
   invalidateCache();
 }
-double CtePowerNode::_eval() { return std::pow(inputAt(0).eval(), _power); }
+double CtePowerNode::_eval() {
+  _operand = inputAt(0).eval();
+  return std::pow(_operand, _power);
+}
 double CtePowerNode::pdiff(const int index) {
-  return _power * std::pow(inputAt(0).eval(), _power - 1);
+  return _power * std::pow(_operand, _power - 1);
 }
 void CtePowerNode::forwardVisit(ComputeNodeVisitor &v) {
   bool skip = v.visit(*this);
@@ -437,14 +545,16 @@ void CtePowerNode::backwardVisit(ComputeNodeVisitor &v) {
 PowerNode::PowerNode(const uint32_t id) : ComputeNode(id) {}
 std::string PowerNode::label() { return "^"; }
 double PowerNode::_eval() {
-  return std::pow(inputAt(0).eval(), inputAt(1).eval());
+  _operands[0] = inputAt(0).eval();
+  _operands[1] = inputAt(1).eval();
+  return std::pow(_operands[0], _operands[1]);
 }
 double PowerNode::pdiff(const int index) {
+  const double x = _operands[0];
+  const double y = _operands[1];
   if (index == 0)
-    return inputAt(1).eval() *
-           std::pow(inputAt(0).eval(), inputAt(1).eval() - 1);
-  return std::pow(inputAt(0).eval(), inputAt(1).eval()) *
-         std::log(inputAt(1).eval());
+    return y * std::pow(x, y - 1);
+  return cachedEval() * std::log(x);
 }
 void PowerNode::forwardVisit(ComputeNodeVisitor &v) {
   bool skip = v.visit(*this);
@@ -465,7 +575,7 @@ void PowerNode::backwardVisit(ComputeNodeVisitor &v) {
 ExpNode::ExpNode(const uint32_t id) : ComputeNode(id) {}
 std::string ExpNode::label() { return "exp"; }
 double ExpNode::_eval() { return std::exp(inputAt(0).eval()); }
-double ExpNode::pdiff(const int index) { return std::exp(inputAt(0).eval()); }
+double ExpNode::pdiff(const int index) { return cachedEval(); }
 void ExpNode::forwardVisit(ComputeNodeVisitor &v) {
   bool skip = v.visit(*this);
   if (skip)
@@ -484,8 +594,11 @@ void ExpNode::backwardVisit(ComputeNodeVisitor &v) {
 // LN
 LnNode::LnNode(const uint32_t id) : ComputeNode(id) {}
 std::string LnNode::label() { return "ln"; }
-double LnNode::_eval() { return std::log(inputAt(0).eval()); }
-double LnNode::pdiff(const int index) { return 1.0 / inputAt(0).eval(); }
+double LnNode::_eval() {
+  _operand = inputAt(0).eval();
+  return std::log(_operand);
+}
+double LnNode::pdiff(const int index) { return 1.0 / _operand; }
 void LnNode::forwardVisit(ComputeNodeVisitor &v) {
   bool skip = v.visit(*this);
   if (skip)
@@ -504,9 +617,12 @@ void LnNode::backwardVisit(ComputeNodeVisitor &v) {
 // ABS
 AbsNode::AbsNode(const uint32_t id) : ComputeNode(id) {}
 std::string AbsNode::label() { return "abs"; }
-double AbsNode::_eval() { return std::abs(inputAt(0).eval()); }
+double AbsNode::_eval() {
+  _operand = inputAt(0).eval();
+  return std::abs(_operand);
+}
 double AbsNode::pdiff(const int index) {
-  const double v = inputAt(0).eval();
+  const double v = _operand;
   if (v == 0.0)
     return 0.0;
   return v < 0 ? -1.0 : 1.0;
@@ -531,8 +647,8 @@ InvertNode::InvertNode(const uint32_t id) : ComputeNode(id) {}
 std::string InvertNode::label() { return "1/x"; }
 double InvertNode::_eval() { return 1.0 / inputAt(0).eval(); }
 double InvertNode::pdiff(const int index) {
-  const double v = inputAt(0).eval();
-  return -1.0 / (v * v);
+  const double v = cachedEval();
+  return -v * v;
 }
 void InvertNode::forwardVisit(ComputeNodeVisitor &v) {
   bool skip = v.visit(*this);
@@ -553,11 +669,8 @@ void InvertNode::backwardVisit(ComputeNodeVisitor &v) {
 AvgNode::AvgNode(const uint32_t id) : ComputeNode(id) {}
 std::string AvgNode::label() { return "AVG"; }
 double AvgNode::_eval() {
-  double avg = 0;
-  const int n = nbInputs();
-  for (int i = 0; i < n; ++i)
-    avg += inputAt(i).eval();
-  return avg / n;
+  const std::vector<double> &operands = gatherInputs(*this);
+  return reduceSum(operands.data(), nbInputs()) / nbInputs();
 }
 double AvgNode::pdiff(const int index) { return 1.0 / nbInputs(); }
 void AvgNode::forwardVisit(ComputeNodeVisitor &v) {
@@ -575,6 +688,26 @@ void AvgNode::backwardVisit(ComputeNodeVisitor &v) {
     inputAt(i).backwardVisit(v);
 }
 
+// STEP
+StepNode::StepNode(const uint32_t id) : ComputeNode(id) {}
+std::string StepNode::label() { return "step"; }
+double StepNode::_eval() { return inputAt(0).eval() <= 0 ? 0.0 : 1.0; }
+double StepNode::pdiff(const int index) { return 0.0; }
+void StepNode::forwardVisit(ComputeNodeVisitor &v) {
+  bool skip = v.visit(*this);
+  if (skip)
+    return;
+  for (int i = 0; i < nbOutputs(); ++i)
+    outputAt(i).forwardVisit(v);
+}
+void StepNode::backwardVisit(ComputeNodeVisitor &v) {
+  bool skip = v.visit(*this);
+  if (skip)
+    return;
+  for (int i = 0; i < nbInputs(); ++i)
+    inputAt(i).backwardVisit(v);
+}
+
 // NODE FACTORY
 NodeFactory::NodeFactory(IComputeGraph &graph) : _graph(graph) {}
 
@@ -633,6 +766,12 @@ SigmoidNode &NodeFactory::createSigmoidNode() const {
   _graph.registerNode(std::move(n));
   return *ptr;
 }
+SineNode &NodeFactory::createSineNode(const double omega) const {
+  auto n = std::make_unique<SineNode>(_graph.newId(), omega);
+  const auto ptr = n.get();
+  _graph.registerNode(std::move(n));
+  return *ptr;
+}
 CtePowerNode &NodeFactory::createCtePowerNode(const int power) const {
   auto n = std::make_unique<CtePowerNode>(_graph.newId(), power);
   const auto ptr = n.get();
@@ -687,5 +826,11 @@ InvertNode &NodeFactory::createInvertNode() const {
   _graph.registerNode(std::move(n));
   return *ptr;
 }
+StepNode &NodeFactory::createStepNode() const {
+  auto n = std::make_unique<StepNode>(_graph.newId());
+  const auto ptr = n.get();
+  _graph.registerNode(std::move(n));
+  return *ptr;
+}
 
 } // namespace ml
\ No newline at end of file
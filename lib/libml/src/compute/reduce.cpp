@@ -0,0 +1,62 @@
+#include "libml/compute/reduce.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace ml {
+
+double reduceSum(const double *values, const int n) {
+  int i = 0;
+  double r = 0.0;
+#if defined(__SSE2__)
+  // Two independent accumulators to hide the add latency
+  __m128d acc0 = _mm_setzero_pd();
+  __m128d acc1 = _mm_setzero_pd();
+  for (; i + 4 <= n; i += 4) {
+    acc0 = _mm_add_pd(acc0, _mm_loadu_pd(values + i));
+    acc1 = _mm_add_pd(acc1, _mm_loadu_pd(values + i + 2));
+  }
+  acc0 = _mm_add_pd(acc0, acc1);
+  r = _mm_cvtsd_f64(_mm_add_sd(acc0, _mm_unpackhi_pd(acc0, acc0)));
+#endif
+  for (; i < n; ++i)
+    r += values[i];
+  return r;
+}
+
+double reduceProduct(const double *values, const int n) {
+  int i = 0;
+  double r = 1.0;
+#if defined(__SSE2__)
+  __m128d acc0 = _mm_set1_pd(1.0);
+  __m128d acc1 = _mm_set1_pd(1.0);
+  for (; i + 4 <= n; i += 4) {
+    acc0 = _mm_mul_pd(acc0, _mm_loadu_pd(values + i));
+    acc1 = _mm_mul_pd(acc1, _mm_loadu_pd(values + i + 2));
+  }
+  acc0 = _mm_mul_pd(acc0, acc1);
+  r = _mm_cvtsd_f64(_mm_mul_sd(acc0, _mm_unpackhi_pd(acc0, acc0)));
+#endif
+  for (; i < n; ++i)
+    r *= values[i];
+  return r;
+}
+
+void reduceProductPartials(const double *values, const int n,
+                           double *partials) {
+  // Prefix products first, then fold the suffix products in backward.
+  // No division, so a zero input still gets the right partials.
+  double prefix = 1.0;
+  for (int i = 0; i < n; ++i) {
+    partials[i] = prefix;
+    prefix *= values[i];
+  }
+  double suffix = 1.0;
+  for (int i = n - 1; i >= 0; --i) {
+    partials[i] *= suffix;
+    suffix *= values[i];
+  }
+}
+
+} // namespace ml
@@ -27,6 +27,7 @@ bool GraphvizVisitor::visit(ConstantNode &n) { return genDot(n, {}); }
 bool GraphvizVisitor::visit(IdentityNode &n) { return genDot(n, {"magenta"}); }
 bool GraphvizVisitor::visit(ReLUNode &n) { return genDot(n, {"magenta"}); }
 bool GraphvizVisitor::visit(SigmoidNode &n) { return genDot(n, {"magenta"}); }
+bool GraphvizVisitor::visit(SineNode &n) { return genDot(n, {"magenta"}); }
 
 bool GraphvizVisitor::visit(MultNode &n) { return genDot(n, {"blue"}); }
 bool GraphvizVisitor::visit(CteMultNode &n) { return genDot(n, {"darkblue"}); }
@@ -54,6 +55,8 @@ bool GraphvizVisitor::visit(InvertNode &n) {
   return genDot(n, {"lightsalmon"});
 }
 
+bool GraphvizVisitor::visit(StepNode &n) { return genDot(n, {"gold"}); }
+
 GraphvizVisitor::~GraphvizVisitor() {}
 GraphvizVisitor::GraphvizVisitor() {}
 
@@ -12,12 +12,18 @@ ComputeNode &ReLUActivation::output() { return _relu; }
 
 SigmoidActivation::SigmoidActivation(IComputeGraph &graph)
     : Activation(graph),
-      _sigmoid(this->Activation::nodeFactory().createReLUNode()) {}
+      _sigmoid(this->Activation::nodeFactory().createSigmoidNode()) {}
 void SigmoidActivation::setInput(ComputeNode &node) {
   createEdge(node, _sigmoid, 0);
 }
 ComputeNode &SigmoidActivation::output() { return _sigmoid; }
 
+SineActivation::SineActivation(IComputeGraph &graph, const double omega)
+    : Activation(graph),
+      _sine(this->Activation::nodeFactory().createSineNode(omega)) {}
+void SineActivation::setInput(ComputeNode &node) { createEdge(node, _sine, 0); }
+ComputeNode &SineActivation::output() { return _sine; }
+
 IdentityActivation::IdentityActivation(IComputeGraph &graph)
     : Activation(graph),
       _id(this->Activation::nodeFactory().createIdentityNode()) {}
@@ -0,0 +1,127 @@
+#include "libml/neural/dense.h"
+
+#include "libml/compute/kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace ml {
+
+DenseLayer::DenseLayer(const int nbInputs, const int size,
+                       const LayerBuilder::Type type, const bool bias)
+    : _nbInputs(nbInputs), _size(size), _type(type), _bias(bias),
+      _weights(size * nbInputs, 0.0), _biases(size, 0.0),
+      _weightDiffs(size * nbInputs, 0.0), _biasDiffs(size, 0.0),
+      _output(size, 0.0), _delta(size, 0.0) {}
+
+int DenseLayer::size() const { return _size; }
+int DenseLayer::nbInputs() const { return _nbInputs; }
+bool DenseLayer::hasBias() const { return _bias; }
+LayerBuilder::Type DenseLayer::type() const { return _type; }
+int DenseLayer::nbWeights() const {
+  return _size * (_nbInputs + (_bias ? 1 : 0));
+}
+
+std::pair<int, int> DenseLayer::_locate(const int index) const {
+  const int stride = _nbInputs + (_bias ? 1 : 0);
+  return {index / stride, index % stride - (_bias ? 1 : 0)};
+}
+
+double DenseLayer::getWeight(const int index) const {
+  const auto [row, column] = _locate(index);
+  return column < 0 ? _biases[row] : _weights[row * _nbInputs + column];
+}
+void DenseLayer::setWeight(const double value, const int index) {
+  const auto [row, column] = _locate(index);
+  if (column < 0)
+    _biases[row] = value;
+  else
+    _weights[row * _nbInputs + column] = value;
+}
+double DenseLayer::getWeightDiff(const int index) const {
+  const auto [row, column] = _locate(index);
+  return column < 0 ? _biasDiffs[row]
+                    : _weightDiffs[row * _nbInputs + column];
+}
+
+void DenseLayer::_activate(double *values, const int n,
+                           double *cosines) const {
+  switch (_type) {
+  case LayerBuilder::Type::ReLu:
+    for (int i = 0; i < n; ++i)
+      values[i] = std::max(0.0, values[i]);
+    break;
+  case LayerBuilder::Type::Sigmoid:
+    for (int i = 0; i < n; ++i)
+      values[i] = 1.0 / (1 + std::exp(-values[i]));
+    break;
+  case LayerBuilder::Type::Sine:
+    for (int i = 0; i < n; ++i)
+      values[i] *= SINE_OMEGA;
+    sinCos(n, values, values, cosines);
+    break;
+  case LayerBuilder::Type::Identity:
+    break;
+  }
+}
+
+double DenseLayer::_activationDiff(const double output) const {
+  switch (_type) {
+  case LayerBuilder::Type::ReLu:
+    return output > 0 ? 1.0 : 0.0;
+  case LayerBuilder::Type::Sigmoid:
+    return output * (1.0 - output);
+  case LayerBuilder::Type::Sine:
+  case LayerBuilder::Type::Identity:
+    return 1.0;
+  }
+  return 1.0;
+}
+
+void DenseLayer::forward(const double *input) {
+  if (_nbInputs == 0)
+    std::transform(input, input + _size, _biases.begin(), _output.begin(),
+                   std::plus());
+  else
+    gemv(_size, _nbInputs, _weights.data(), input, _biases.data(),
+         _output.data());
+  if (_type == LayerBuilder::Type::Sine)
+    _cosines.resize(_size);
+  _activate(_output.data(), _size, _cosines.data());
+}
+
+const double *DenseLayer::output() const { return _output.data(); }
+
+void DenseLayer::forwardBatch(const double *inputs, const int batch,
+                              double *outputs) const {
+  if (_nbInputs == 0)
+    for (int s = 0; s < batch; ++s)
+      std::transform(inputs + s * _size, inputs + (s + 1) * _size,
+                     _biases.begin(), outputs + s * _size, std::plus());
+  else
+    gemm(batch, _size, _nbInputs, inputs, _weights.data(), _biases.data(),
+         outputs);
+  _activate(outputs, batch * _size, nullptr);
+}
+
+void DenseLayer::backward(const double *input, const double *outputDiff,
+                          double *inputDiff) {
+  for (int j = 0; j < _size; ++j)
+    _delta[j] = outputDiff[j] * (_type == LayerBuilder::Type::Sine
+                                     ? SINE_OMEGA * _cosines[j]
+                                     : _activationDiff(_output[j]));
+  if (_bias)
+    std::copy(_delta.begin(), _delta.end(), _biasDiffs.begin());
+  if (_nbInputs == 0) {
+    if (inputDiff)
+      std::copy(_delta.begin(), _delta.end(), inputDiff);
+    return;
+  }
+  outerProduct(_size, _nbInputs, _delta.data(), input, _weightDiffs.data());
+  if (inputDiff)
+    gemvTransposed(_size, _nbInputs, _weights.data(), _delta.data(),
+                   inputDiff);
+}
+
+} // namespace ml
@@ -0,0 +1,277 @@
+#include "libml/neural/encodings.h"
+
+#include "libml/compute/kernels.h"
+
+#include "source.h"
+
+#include "effolkronium/random.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+
+using Random = effolkronium::random_static;
+
+namespace ml {
+
+// Encoding
+//------------------------------------------------------------------------------
+void Encoding::setDataSet(const DataSet &dataSet) {}
+
+void Encoding::encodeSample(const DataSet &dataSet, const int index,
+                            double *output) const {
+  std::vector<double> input(nbInputs());
+  for (int i = 0; i < nbInputs(); ++i)
+    input[i] = dataSet.inputTable().get(index, i);
+  encode(input.data(), output);
+}
+
+// HashGridEncoding
+//------------------------------------------------------------------------------
+HashGridEncoding::HashGridEncoding(const int nbLevels, const int nbFeatures,
+                                   const int log2TableSize,
+                                   const int baseResolution,
+                                   const int maxResolution,
+                                   const double learningRate)
+    : learningRate(learningRate), _nbLevels(nbLevels),
+      _nbFeatures(nbFeatures), _tableSize(1 << log2TableSize) {
+  assert(nbLevels > 0 && nbFeatures > 0 && "ERROR: empty encoding");
+  assert(log2TableSize > 0 && log2TableSize < 31 &&
+         "ERROR: invalid table size");
+  assert(baseResolution > 0 && maxResolution >= baseResolution &&
+         "ERROR: invalid resolutions");
+  // Geometric progression from the base to the max resolution
+  const double growth =
+      nbLevels > 1 ? std::exp((std::log(maxResolution) -
+                               std::log(baseResolution)) /
+                              (nbLevels - 1))
+                   : 1.0;
+  for (int l = 0; l < nbLevels; ++l)
+    _resolutions.push_back(
+        static_cast<int>(std::floor(baseResolution * std::pow(growth, l))));
+
+  // Small values so that every level starts close to zero
+  std::uniform_real_distribution<double> d{-1e-4, 1e-4};
+  _table.resize(static_cast<size_t>(nbLevels) * _tableSize * nbFeatures);
+  for (double &v : _table)
+    v = Random::get(d);
+}
+
+int HashGridEncoding::nbInputs() const { return 2; }
+int HashGridEncoding::nbOutputs() const { return _nbLevels * _nbFeatures; }
+int HashGridEncoding::nbLevels() const { return _nbLevels; }
+int HashGridEncoding::nbFeatures() const { return _nbFeatures; }
+int HashGridEncoding::tableSize() const { return _tableSize; }
+int HashGridEncoding::resolution(const int level) const {
+  return _resolutions[level];
+}
+int HashGridEncoding::nbParameters() const {
+  return static_cast<int>(_table.size());
+}
+
+void HashGridEncoding::_corners(const double *input, const int level,
+                                std::array<int, 4> &entries,
+                                std::array<double, 4> &weights) const {
+  const int res = _resolutions[level];
+  const double px = std::clamp(input[0], 0.0, 1.0) * res;
+  const double py = std::clamp(input[1], 0.0, 1.0) * res;
+  const int x0 = std::min(static_cast<int>(px), res - 1);
+  const int y0 = std::min(static_cast<int>(py), res - 1);
+  const double fx = px - x0, fy = py - y0;
+
+  const bool direct = (res + 1) * (res + 1) <= _tableSize;
+  for (int c = 0; c < 4; ++c) {
+    const uint32_t x = x0 + (c & 1), y = y0 + (c >> 1);
+    // Same prime as the reference implementation, x keeps a factor of 1
+    const uint32_t entry = direct ? y * (res + 1) + x
+                                  : (x ^ (y * 2654435761u)) & (_tableSize - 1);
+    entries[c] = level * _tableSize + static_cast<int>(entry);
+  }
+  weights = {(1 - fx) * (1 - fy), fx * (1 - fy), (1 - fx) * fy, fx * fy};
+}
+
+void HashGridEncoding::encode(const double *input, double *output) const {
+  std::array<int, 4> entries{};
+  std::array<double, 4> weights{};
+  for (int l = 0; l < _nbLevels; ++l) {
+    _corners(input, l, entries, weights);
+    double *out = output + l * _nbFeatures;
+    std::fill(out, out + _nbFeatures, 0.0);
+    for (int c = 0; c < 4; ++c) {
+      const double *features = &_table[entries[c] * _nbFeatures];
+      for (int f = 0; f < _nbFeatures; ++f)
+        out[f] += weights[c] * features[f];
+    }
+  }
+}
+
+void HashGridEncoding::backward(const double *input,
+                                const double *outputDiff) {
+  std::array<int, 4> entries{};
+  std::array<double, 4> weights{};
+  for (int l = 0; l < _nbLevels; ++l) {
+    _corners(input, l, entries, weights);
+    const double *diff = outputDiff + l * _nbFeatures;
+    for (int c = 0; c < 4; ++c) {
+      double *features = &_table[entries[c] * _nbFeatures];
+      for (int f = 0; f < _nbFeatures; ++f)
+        features[f] -= learningRate * weights[c] * diff[f];
+    }
+  }
+}
+
+std::unique_ptr<Encoding> HashGridEncoding::clone() const {
+  return std::make_unique<HashGridEncoding>(*this);
+}
+
+void HashGridEncoding::writeSource(std::ostream &out) const {
+  out << "inline constexpr int ENCODING_LEVELS = " << _nbLevels << ";\n"
+      << "inline constexpr int ENCODING_FEATURES = " << _nbFeatures << ";\n"
+      << "inline constexpr unsigned ENCODING_TABLE_SIZE = " << _tableSize
+      << ";\n"
+      << "inline constexpr int ENCODING_RESOLUTIONS[" << _nbLevels << "] = {";
+  for (int l = 0; l < _nbLevels; ++l)
+    out << _resolutions[l] << (l + 1 < _nbLevels ? ", " : "};\n");
+  writeFloatArray(out, "ENCODING_TABLE", _table);
+  // Same steps as _corners() then encode()
+  out << R"(
+inline void encode(float x, float y, float *output) {
+  x = x < 0.0f ? 0.0f : x > 1.0f ? 1.0f : x;
+  y = y < 0.0f ? 0.0f : y > 1.0f ? 1.0f : y;
+  for (int l = 0; l < ENCODING_LEVELS; ++l) {
+    const int res = ENCODING_RESOLUTIONS[l];
+    const float px = x * res, py = y * res;
+    const int x0 = static_cast<int>(px) < res ? static_cast<int>(px) : res - 1;
+    const int y0 = static_cast<int>(py) < res ? static_cast<int>(py) : res - 1;
+    const float fx = px - x0, fy = py - y0;
+    const float weights[4] = {(1 - fx) * (1 - fy), fx * (1 - fy),
+                              (1 - fx) * fy, fx * fy};
+    const bool direct = static_cast<unsigned>((res + 1) * (res + 1)) <=
+                        ENCODING_TABLE_SIZE;
+    float *out = output + l * ENCODING_FEATURES;
+    for (int f = 0; f < ENCODING_FEATURES; ++f)
+      out[f] = 0.0f;
+    for (int c = 0; c < 4; ++c) {
+      const std::uint32_t cx = x0 + (c & 1), cy = y0 + (c >> 1);
+      const std::uint32_t entry =
+          direct ? cy * (res + 1) + cx
+                 : (cx ^ (cy * 2654435761u)) & (ENCODING_TABLE_SIZE - 1);
+      const std::uint32_t index = l * ENCODING_TABLE_SIZE + entry;
+      const float *features = &ENCODING_TABLE[index * ENCODING_FEATURES];
+      for (int f = 0; f < ENCODING_FEATURES; ++f)
+        out[f] += weights[c] * features[f];
+    }
+  }
+}
+)";
+}
+
+// FourierEncoding
+//------------------------------------------------------------------------------
+FourierEncoding::FourierEncoding(const int nbFrequencies, const Bands bands,
+                                 const double scale, const bool keepInputs)
+    : _keepInputs(keepInputs) {
+  assert(nbFrequencies > 0 && "ERROR: no frequency");
+  if (bands == Bands::LogSpaced) {
+    for (int k = 0; k < nbFrequencies; ++k) {
+      const double f = std::ldexp(1.0, k);
+      _frequencies.insert(_frequencies.end(), {f, 0.0, 0.0, f});
+    }
+  } else {
+    // As many vectors as the log-spaced bands
+    std::normal_distribution<double> d{0.0, scale};
+    for (int k = 0; k < 4 * nbFrequencies; ++k)
+      _frequencies.push_back(Random::get(d));
+  }
+}
+
+int FourierEncoding::nbInputs() const { return 2; }
+int FourierEncoding::nbOutputs() const {
+  return static_cast<int>(_frequencies.size()) + (_keepInputs ? 2 : 0);
+}
+
+void FourierEncoding::_encodeRows(const double *inputs, const int nbRows,
+                                  double *outputs) const {
+  const int nbBands = static_cast<int>(_frequencies.size()) / 2;
+  const int offset = _keepInputs ? 2 : 0;
+  // Phases of all the rows, then their sines and cosines in one pass
+  std::vector<double> phases(nbRows * nbBands);
+  for (int r = 0; r < nbRows; ++r)
+    for (int k = 0; k < nbBands; ++k)
+      phases[r * nbBands + k] =
+          2 * std::numbers::pi * (_frequencies[2 * k] * inputs[2 * r] +
+                      _frequencies[2 * k + 1] * inputs[2 * r + 1]);
+  std::vector<double> sines(phases.size()), cosines(phases.size());
+  sinCos(static_cast<int>(phases.size()), phases.data(), sines.data(),
+         cosines.data());
+  const int width = nbOutputs();
+  for (int r = 0; r < nbRows; ++r) {
+    double *out = outputs + r * width;
+    if (_keepInputs) {
+      out[0] = inputs[2 * r];
+      out[1] = inputs[2 * r + 1];
+    }
+    std::copy_n(&sines[r * nbBands], nbBands, out + offset);
+    std::copy_n(&cosines[r * nbBands], nbBands, out + offset + nbBands);
+  }
+}
+
+void FourierEncoding::encode(const double *input, double *output) const {
+  _encodeRows(input, 1, output);
+}
+
+void FourierEncoding::setDataSet(const DataSet &dataSet) {
+  const int nbRows = dataSet.size();
+  std::vector<double> inputs(2 * nbRows);
+  for (int r = 0; r < nbRows; ++r) {
+    inputs[2 * r] = dataSet.inputTable().get(r, 0);
+    inputs[2 * r + 1] = dataSet.inputTable().get(r, 1);
+  }
+  _cache.resize(static_cast<size_t>(nbRows) * nbOutputs());
+  _encodeRows(inputs.data(), nbRows, _cache.data());
+  _cachedDataSet = &dataSet;
+}
+
+void FourierEncoding::encodeSample(const DataSet &dataSet, const int index,
+                                   double *output) const {
+  if (&dataSet != _cachedDataSet) {
+    Encoding::encodeSample(dataSet, index, output);
+    return;
+  }
+  const int width = nbOutputs();
+  std::copy_n(&_cache[static_cast<size_t>(index) * width], width, output);
+}
+
+void FourierEncoding::backward(const double *input, const double *outputDiff) {
+}
+
+std::unique_ptr<Encoding> FourierEncoding::clone() const {
+  // Without the cache, a copy only evaluates
+  auto copy = std::make_unique<FourierEncoding>(*this);
+  copy->_cachedDataSet = nullptr;
+  copy->_cache.clear();
+  return copy;
+}
+
+void FourierEncoding::writeSource(std::ostream &out) const {
+  const int nbBands = static_cast<int>(_frequencies.size()) / 2;
+  out << "inline constexpr int ENCODING_BANDS = " << nbBands << ";\n";
+  writeFloatArray(out, "ENCODING_FREQUENCIES", _frequencies);
+  out << "\ninline void encode(float x, float y, float *output) {\n";
+  if (_keepInputs)
+    out << "  output[0] = x;\n"
+        << "  output[1] = y;\n"
+        << "  output += 2;\n";
+  out << R"(  for (int k = 0; k < ENCODING_BANDS; ++k) {
+    const float phase = 6.28318531f * (ENCODING_FREQUENCIES[2 * k] * x +
+                                       ENCODING_FREQUENCIES[2 * k + 1] * y);
+    output[k] = std::sin(phase);
+    output[ENCODING_BANDS + k] = std::cos(phase);
+  }
+}
+)";
+}
+
+} // namespace ml
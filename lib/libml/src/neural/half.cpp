@@ -0,0 +1,86 @@
+#include "libml/neural/half.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace ml {
+
+namespace {
+// Weights of exportWeights() back to double
+std::vector<double> widen(const HalfFormat format,
+                          const std::vector<uint16_t> &weights) {
+  std::vector<double> wide(weights.size());
+  for (int i = 0; i < weights.size(); ++i)
+    wide[i] = fromHalf(format, weights[i]);
+  return wide;
+}
+} // namespace
+
+HalfMLP::HalfMLP(const InferenceModel &model, const HalfFormat format)
+    : _format(format), _encoding(model.encoding()),
+      _nbInputs(model.nbInputs()), _first(model.layers().front()) {
+  const std::vector<InferenceLayer> &layers = model.layers();
+  for (int l = 1; l < layers.size(); ++l) {
+    const InferenceLayer &source = layers[l];
+    Layer layer{source.nbInputs, source.size, source.type,
+                std::vector<uint16_t>(source.size * source.nbInputs),
+                std::vector<float>(source.biases.begin(),
+                                   source.biases.end())};
+    for (int j = 0; j < source.size; ++j)
+      for (int k = 0; k < source.nbInputs; ++k)
+        layer.weights[k * source.size + j] = toHalf(
+            format, static_cast<float>(source.weights[j * source.nbInputs + k]));
+    _layers.push_back(std::move(layer));
+  }
+}
+
+HalfMLP::HalfMLP(const std::vector<LayerBuilder> &topology,
+                 const HalfFormat format,
+                 const std::vector<uint16_t> &weights)
+    : HalfMLP(InferenceModel(topology, widen(format, weights)), format) {}
+
+int HalfMLP::nbInputs() const { return _nbInputs; }
+int HalfMLP::nbOutputs() const { return _layers.back().size; }
+HalfFormat HalfMLP::format() const { return _format; }
+
+int HalfMLP::nbBytes() const {
+  int total = static_cast<int>(_first.biases.size() * sizeof(double));
+  for (const Layer &layer : _layers)
+    total += static_cast<int>(layer.weights.size() * sizeof(uint16_t) +
+                              layer.biases.size() * sizeof(float));
+  return total;
+}
+
+void HalfMLP::evaluate(const std::span<const float> coords,
+                       const std::span<float> rgb) const {
+  const int batch = static_cast<int>(coords.size()) / nbInputs();
+  assert(batch * nbInputs() == coords.size() &&
+         "ERROR: partial sample in the coordinates");
+  assert(batch * nbOutputs() == rgb.size() &&
+         "ERROR: the outputs don't match the coordinates");
+  int width = _first.size;
+  for (const Layer &layer : _layers)
+    width = std::max(width, layer.size);
+  // The activations run on doubles, the layers on floats
+  std::vector<double> wide(width);
+  std::vector<float> values(width);
+  std::vector<uint16_t> halves(width);
+  for (int s = 0; s < batch; ++s) {
+    inputValues(_encoding.get(), _first, nbInputs(),
+                coords.data() + s * nbInputs(), wide.data());
+    activate(_first.type, wide.data(), _first.size);
+    std::copy_n(wide.data(), _first.size, values.data());
+    for (const Layer &layer : _layers) {
+      toHalf(_format, layer.nbInputs, values.data(), halves.data());
+      gemvHalfTransposed(_format, layer.nbInputs, layer.size,
+                         layer.weights.data(), halves.data(),
+                         layer.biases.data(), values.data());
+      std::copy_n(values.data(), layer.size, wide.data());
+      activate(layer.type, wide.data(), layer.size);
+      std::copy_n(wide.data(), layer.size, values.data());
+    }
+    std::copy_n(values.data(), nbOutputs(), rgb.begin() + s * nbOutputs());
+  }
+}
+
+} // namespace ml
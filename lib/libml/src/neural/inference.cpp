@@ -0,0 +1,219 @@
+#include "libml/neural/inference.h"
+
+#include "libml/compute/kernels.h"
+
+#include "source.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <fstream>
+
+namespace ml {
+
+namespace {
+// Samples evaluated together, the values of a layer stay in cache
+constexpr int CHUNK = 256;
+
+bool anyNonZero(const std::vector<double> &values) {
+  return std::any_of(values.begin(), values.end(),
+                     [](const double v) { return v != 0.0; });
+}
+
+// C++ statement applying an activation to a value v of the exported source
+std::string activationSource(const LayerBuilder::Type type) {
+  switch (type) {
+  case LayerBuilder::Type::ReLu:
+    return "v = v > 0.0f ? v : 0.0f;";
+  case LayerBuilder::Type::Sigmoid:
+    return "v = 1.0f / (1.0f + std::exp(-v));";
+  case LayerBuilder::Type::Sine:
+    return "v = std::sin(" + floatLiteral(SINE_OMEGA) + " * v);";
+  case LayerBuilder::Type::Identity:
+    break;
+  }
+  return "";
+}
+} // namespace
+
+void activate(const LayerBuilder::Type type, double *values, const int n) {
+  switch (type) {
+  case LayerBuilder::Type::ReLu:
+    for (int i = 0; i < n; ++i)
+      values[i] = std::max(0.0, values[i]);
+    break;
+  case LayerBuilder::Type::Sigmoid:
+    for (int i = 0; i < n; ++i)
+      values[i] = 1.0 / (1 + std::exp(-values[i]));
+    break;
+  case LayerBuilder::Type::Sine:
+    for (int i = 0; i < n; ++i)
+      values[i] *= SINE_OMEGA;
+    sinCos(n, values, values, nullptr);
+    break;
+  case LayerBuilder::Type::Identity:
+    break;
+  }
+}
+
+void inputValues(const Encoding *encoding, const InferenceLayer &first,
+                 const int nbInputs, const float *coords, double *values) {
+  if (encoding) {
+    thread_local std::vector<double> point;
+    point.assign(coords, coords + nbInputs);
+    encoding->encode(point.data(), values);
+  } else
+    std::copy_n(coords, first.size, values);
+  for (int j = 0; j < first.size; ++j)
+    values[j] += first.biases[j];
+}
+
+InferenceModel::InferenceModel(const std::vector<LayerBuilder> &topology,
+                               const std::vector<double> &weights,
+                               const Encoding *encoding)
+    : _encoding(encoding ? std::shared_ptr<const Encoding>(encoding->clone())
+                         : nullptr) {
+  assert(topology.size() >= 2 && "ERROR: no layer to evaluate");
+  assert((!encoding || encoding->nbOutputs() == topology.front().size) &&
+         "ERROR: the encoding doesn't match the mlp inputs");
+  int index = 0;
+  for (int l = 0; l < topology.size(); ++l) {
+    const LayerBuilder &b = topology[l];
+    const int nbInputs = l == 0 ? 0 : topology[l - 1].size;
+    InferenceLayer layer{nbInputs, b.size, b.type,
+                std::vector<double>(b.size * nbInputs),
+                std::vector<double>(b.size, 0.0)};
+    assert(index + b.size * (nbInputs + b.bias) <= weights.size() &&
+           "ERROR: not enough weights for the topology");
+    for (int j = 0; j < b.size; ++j) {
+      if (b.bias)
+        layer.biases[j] = weights[index++];
+      std::copy_n(weights.begin() + index, nbInputs,
+                  layer.weights.begin() + j * nbInputs);
+      index += nbInputs;
+    }
+    _layers.push_back(std::move(layer));
+  }
+  assert(index == weights.size() && "ERROR: too many weights for the topology");
+}
+
+int InferenceModel::nbInputs() const {
+  return _encoding ? _encoding->nbInputs() : _layers.front().size;
+}
+int InferenceModel::nbOutputs() const { return _layers.back().size; }
+
+const std::vector<InferenceLayer> &InferenceModel::layers() const {
+  return _layers;
+}
+
+const std::shared_ptr<const Encoding> &InferenceModel::encoding() const {
+  return _encoding;
+}
+
+void InferenceModel::evaluate(const std::span<const float> coords,
+                              const std::span<float> rgb) const {
+  const int batch = static_cast<int>(coords.size()) / nbInputs();
+  assert(batch * nbInputs() == coords.size() &&
+         "ERROR: partial sample in the coordinates");
+  assert(batch * nbOutputs() == rgb.size() &&
+         "ERROR: the outputs don't match the coordinates");
+  const InferenceLayer &first = _layers.front();
+  std::vector<double> values, next;
+  for (int s0 = 0; s0 < batch; s0 += CHUNK) {
+    const int n = std::min(CHUNK, batch - s0);
+    values.resize(n * first.size);
+    for (int s = 0; s < n; ++s)
+      inputValues(_encoding.get(), first, nbInputs(),
+                  coords.data() + (s0 + s) * nbInputs(),
+                  values.data() + s * first.size);
+    activate(first.type, values.data(), n * first.size);
+    for (int l = 1; l < _layers.size(); ++l) {
+      const InferenceLayer &layer = _layers[l];
+      next.resize(n * layer.size);
+      gemm(n, layer.size, layer.nbInputs, values.data(),
+           layer.weights.data(), layer.biases.data(), next.data());
+      std::swap(values, next);
+      activate(layer.type, values.data(), n * layer.size);
+    }
+    std::copy(values.begin(), values.end(), rgb.begin() + s0 * nbOutputs());
+  }
+}
+
+void InferenceModel::writeSource(std::ostream &out,
+                                 const std::string &name) const {
+  assert(nbInputs() == 2 && nbOutputs() == 3 &&
+         "ERROR: only models from coordinates to colors can be exported");
+  out << "// Generated by CBNN-Playground, standalone: no need for libml\n"
+      << "// Topology:";
+  for (const InferenceLayer &layer : _layers)
+    out << " " << layer.size;
+  out << "\n\n#pragma once\n\n#include <cmath>\n#include <cstdint>\n"
+      << "#include <limits>\n\n"
+      << "namespace " << name << " {\n\n";
+  if (_encoding) {
+    _encoding->writeSource(out);
+    out << "\n";
+  }
+
+  // Weights transposed, input after input: the inner loop of a layer goes
+  // over contiguous outputs and vectorizes without reassociating sums
+  for (int l = 1; l < _layers.size(); ++l) {
+    const InferenceLayer &layer = _layers[l];
+    std::vector<double> transposed(layer.weights.size());
+    for (int j = 0; j < layer.size; ++j)
+      for (int i = 0; i < layer.nbInputs; ++i)
+        transposed[i * layer.size + j] = layer.weights[j * layer.nbInputs + i];
+    writeFloatArray(out, "W" + std::to_string(l), transposed);
+  }
+  for (int l = 0; l < _layers.size(); ++l)
+    if (anyNonZero(_layers[l].biases))
+      writeFloatArray(out, "B" + std::to_string(l), _layers[l].biases);
+
+  // One block per layer, every bound a constant
+  out << "\ninline void eval(float x, float y, float rgb[3]) {\n";
+  for (int l = 0; l < _layers.size(); ++l) {
+    const InferenceLayer &layer = _layers[l];
+    const std::string values = "l" + std::to_string(l);
+    const std::string size = std::to_string(layer.size);
+    const bool bias = anyNonZero(layer.biases);
+    out << "  float " << values << "[" << size << "];\n";
+    if (l == 0) {
+      if (_encoding)
+        out << "  encode(x, y, " << values << ");\n";
+      else
+        out << "  " << values << "[0] = x;\n  " << values << "[1] = y;\n";
+      if (bias)
+        out << "  for (int j = 0; j < " << size << "; ++j)\n    " << values
+            << "[j] += B0[j];\n";
+    } else {
+      const std::string previous = "l" + std::to_string(l - 1);
+      out << "  for (int j = 0; j < " << size << "; ++j)\n    " << values
+          << "[j] = " << (bias ? "B" + std::to_string(l) + "[j]" : "0.0f")
+          << ";\n"
+          << "  for (int i = 0; i < " << layer.nbInputs << "; ++i)\n"
+          << "    for (int j = 0; j < " << size << "; ++j)\n      "
+          << values << "[j] += " << previous << "[i] * W" << l << "[i * "
+          << size << " + j];\n";
+    }
+    const std::string activation = activationSource(layer.type);
+    if (!activation.empty())
+      out << "  for (float &v : " << values << ")\n    " << activation
+          << "\n";
+  }
+  out << "  for (int j = 0; j < 3; ++j)\n    rgb[j] = l"
+      << _layers.size() - 1 << "[j];\n}\n\n} // namespace " << name
+      << "\n";
+}
+
+bool InferenceModel::saveSource(const std::string &path,
+                                const std::string &name) const {
+  std::ofstream outFile;
+  outFile.open(path, std::ios_base::out);
+  if (!outFile)
+    return false;
+  writeSource(outFile, name);
+  outFile.close();
+  return !outFile.fail();
+}
+
+} // namespace ml
@@ -2,6 +2,8 @@
 
 #include "effolkronium/random.hpp"
 
+#include <cassert>
+
 using Random = effolkronium::random_static;
 
 namespace ml {
@@ -13,15 +15,20 @@ Layer::~Layer() {
     delete n;
 }
 
-void Layer::connectToLayer(const Layer &other) const {
+void Layer::connectToLayer(const Layer &other,
+                           const bool fromInputLayer) const {
   std::normal_distribution<double> d{
       0.0, std::sqrt(2.0 / static_cast<double>(_neurons.size()))};
-  for (const auto _neuron : _neurons) {
-    for (int j = 0; j < other.size(); ++j) {
-      double w = Random::get(d);
-      _neuron->connectToNeuron(other.getNeuron(j), w);
-    }
-  }
+  // Draw every weight up front so they do not depend on the scheduling
+  const int nbOther = other.size();
+  std::vector<double> weights(_neurons.size() * nbOther);
+  for (double &w : weights)
+    w = other.sirenInit() ? sirenWeight(size(), fromInputLayer)
+                          : Random::get(d);
+  // A column only adds inputs to its own neuron of the other layer
+  buildGridInParallel(size(), nbOther, [&](const int i, const int j) {
+    _neurons[i]->connectToNeuron(other.getNeuron(j), weights[i * nbOther + j]);
+  });
 }
 void Layer::addInput(ComputeNode &node) const {
   std::normal_distribution d{
@@ -32,69 +39,86 @@ void Layer::addInput(ComputeNode &node) const {
   }
 }
 
+void Layer::removeInputs(const int first) const {
+  for (Neuron *n : _neurons)
+    n->removeInputs(first);
+}
+
+bool Layer::sirenInit() const { return false; }
+
 Neuron &Layer::getNeuron(const int index) const { return *_neurons[index]; }
 int Layer::size() const { return static_cast<int>(_neurons.size()); }
 
 void Layer::addNeuron(Neuron *n) { _neurons.push_back(n); }
 
+void Layer::addNeurons(const int size) {
+  std::vector<Neuron *> neurons(size);
+  buildInParallel(size, [&](const int i) { neurons[i] = createNeuron(); });
+  for (Neuron *n : neurons)
+    addNeuron(n);
+}
+
+void Layer::addBiasInput() {
+  ConstantNode &b = nodeFactory().createConstantNode(1.0);
+  b.setLabelPrefix("B: ");
+  addInput(b);
+  _bias = &b;
+}
+
+void Layer::resize(const int size) {
+  for (; _neurons.size() > size; _neurons.pop_back())
+    delete _neurons.back();
+  const int first = this->size();
+  addNeurons(size - first);
+  if (_bias)
+    for (int i = first; i < size; ++i)
+      _neurons[i]->addInput(*_bias, true, 0.0);
+}
+
 ComputeNode &Layer::getWeight(const int index) const {
-  int i = 0;
-  for (const auto n : _neurons) {
-    for (int j = 0; j < n->nbWeights(); ++j) {
-      if (i == index)
-        return n->getWeight(j);
-      ++i;
-    }
-  }
-  return _neurons[0]->getWeight(0);
+  assert(index >= 0 && index < nbWeights() && "ERROR: no such weight");
+  const int perNeuron = _neurons[0]->nbWeights();
+  return _neurons[index / perNeuron]->getWeight(index % perNeuron);
 }
 
 int Layer::nbWeights() const {
-  int total = 0;
-  for (const auto n : _neurons)
-    total += n->nbWeights();
-  return total;
+  return _neurons.empty() ? 0 : size() * _neurons[0]->nbWeights();
 }
 
+int Layer::firstWeight() const { return _firstWeight; }
+
 // Layer types
 LayerReLU::LayerReLU(IComputeGraph &graph, const int size, const bool addBias)
     : Layer(graph) {
-  for (int i = 0; i < size; ++i) {
-    addNeuron(new NeuronReLu(*this));
-  }
-  // Bias
-  if (addBias) {
-    ConstantNode &b = Layer::nodeFactory().createConstantNode(1.0);
-    b.setLabelPrefix("B: ");
-    addInput(b);
-  }
+  addNeurons(size);
+  if (addBias)
+    addBiasInput();
 }
+Neuron *LayerReLU::createNeuron() { return new NeuronReLu(*this); }
 LayerSigmoid::LayerSigmoid(IComputeGraph &graph, const int size,
                            const bool addBias)
     : Layer(graph) {
-  for (int i = 0; i < size; ++i) {
-    addNeuron(new NeuronSigmoid(*this));
-  }
-  // Bias
-  if (addBias) {
-    ConstantNode &b = Layer::nodeFactory().createConstantNode(1.0);
-    b.setLabelPrefix("B: ");
-    addInput(b);
-  }
+  addNeurons(size);
+  if (addBias)
+    addBiasInput();
 }
+Neuron *LayerSigmoid::createNeuron() { return new NeuronSigmoid(*this); }
+LayerSine::LayerSine(IComputeGraph &graph, const int size, const bool addBias)
+    : Layer(graph) {
+  addNeurons(size);
+  if (addBias)
+    addBiasInput();
+}
+bool LayerSine::sirenInit() const { return true; }
+Neuron *LayerSine::createNeuron() { return new NeuronSine(*this, SINE_OMEGA); }
 LayerIdentity::LayerIdentity(IComputeGraph &graph, const int size,
                              const bool addBias)
     : Layer(graph) {
-  for (int i = 0; i < size; ++i) {
-    addNeuron(new NeuronIdentity(*this));
-  }
-  // Bias
-  if (addBias) {
-    ConstantNode &b = Layer::nodeFactory().createConstantNode(1.0);
-    b.setLabelPrefix("B: ");
-    addInput(b);
-  }
+  addNeurons(size);
+  if (addBias)
+    addBiasInput();
 }
+Neuron *LayerIdentity::createNeuron() { return new NeuronIdentity(*this); }
 
 // Layer builder
 std::unique_ptr<Layer> LayerBuilder::build(IComputeGraph &graph) {
@@ -105,9 +129,21 @@ std::unique_ptr<Layer> LayerBuilder::build(IComputeGraph &graph) {
     return std::make_unique<LayerSigmoid>(graph, size, bias);
   case Type::Identity:
     return std::make_unique<LayerIdentity>(graph, size, bias);
+  case Type::Sine:
+    return std::make_unique<LayerSine>(graph, size, bias);
   }
   return std::make_unique<LayerIdentity>(graph, size, bias);
 }
-LayerBuilder::LayerBuilder(const int size, const Type type, const bool addBias)
-    : size(size), type(type), bias(addBias) {}
+LayerBuilder::LayerBuilder(const int size, const Type type, const bool addBias,
+                           const Backend backend)
+    : size(size), type(type), bias(addBias), backend(backend) {}
+
+double sirenWeight(const int nbInputs, const bool fromInputLayer) {
+  // The first layer spans several periods over the input range, the next
+  // ones are divided by omega so that omega * (w.x) stays well distributed
+  const double n = static_cast<double>(nbInputs);
+  const double range =
+      fromInputLayer ? 1.0 / n : std::sqrt(6.0 / n) / SINE_OMEGA;
+  return Random::get(std::uniform_real_distribution<double>{-range, range});
+}
 } // namespace ml
@@ -1,11 +1,46 @@
 #include "libml/neural/mlp.h"
 #include "libml/neural/neuron.h"
 
+#include "effolkronium/random.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numeric>
+
+using Random = effolkronium::random_static;
+
 namespace ml {
 
+namespace {
+// Weights of each neuron of a layer: its bias then one per input
+int rowSize(const std::vector<LayerBuilder> &layers, const int l) {
+  return (l == 0 ? 0 : layers[l - 1].size) + (layers[l].bias ? 1 : 0);
+}
+
+// Indices of the weights between two neurons, the biases left out
+std::vector<int> connections(const std::vector<LayerBuilder> &layers) {
+  std::vector<int> result;
+  int first = 0;
+  for (int l = 0; l < layers.size(); ++l) {
+    const int row = rowSize(layers, l);
+    for (int j = 0; j < layers[l].size; ++j)
+      for (int c = layers[l].bias ? 1 : 0; c < row; ++c)
+        result.push_back(first + j * row + c);
+    first += layers[l].size * row;
+  }
+  return result;
+}
+} // namespace
+
 // MLP
 MLP::MLP(IComputeGraph &graph, const std::vector<LayerBuilder> &layers)
-    : ComputeSubGraph(graph) {
+    : ComputeSubGraph(graph), _builders(layers) {
+
+  if (layers[0].backend == LayerBuilder::Backend::Dense) {
+    _buildDense(layers);
+    return;
+  }
 
   // Create all layers
   for (LayerBuilder b : layers) {
@@ -27,19 +62,30 @@ MLP::MLP(IComputeGraph &graph, const std::vector<LayerBuilder> &layers)
 
   // Connect each layers
   for (int i = 0; i < _layers.size() - 1; ++i) {
-    _layers[i]->connectToLayer(*_layers[i + 1]);
+    _layers[i]->connectToLayer(*_layers[i + 1], i == 0);
   }
 
-  // Keep a reference to all weights
-  for (const auto layer : _layers)
-    for (int i = 0; i < layer->nbWeights(); ++i)
-      _weights.push_back(&layer->getWeight(i));
+  _collectWeights();
 
   // Keep a reference to all outputs
   const Layer *outLayer = _layers[_layers.size() - 1];
   for (int i = 0; i < outLayer->size(); ++i)
     _outputs.push_back(&outLayer->getNeuron(i).output());
 }
+
+void MLP::_collectWeights() {
+  // Keep a reference to all weights, each layer gets the range of its own
+  int total = 0;
+  for (const auto layer : _layers)
+    total += layer->nbWeights();
+  _weights.clear();
+  _weights.reserve(total);
+  for (const auto layer : _layers) {
+    layer->_firstWeight = static_cast<int>(_weights.size());
+    for (int i = 0; i < layer->nbWeights(); ++i)
+      _weights.push_back(&layer->getWeight(i));
+  }
+}
 MLP::~MLP() {
   for (const auto layer : _layers)
     delete layer;
@@ -47,30 +93,79 @@ MLP::~MLP() {
 int MLP::nbInputs() const { return static_cast<int>(_inputs.size()); }
 int MLP::nbOutputs() const { return static_cast<int>(_outputs.size()); }
 
+ComputeNode &MLP::getInputNode(const int index) const {
+  return *_inputs[index];
+}
 ComputeNode &MLP::getOutputNode(const int index) const {
   return *_outputs[index];
 }
 
 void MLP::setInput(const double value, const int index) const {
   static_cast<ConstantNode *>(_inputs[index])->set(value);
+  _denseDirty = true;
 }
 
-double MLP::getOutput(const int index) const { return _outputs[index]->eval(); }
+double MLP::getOutput(const int index) const {
+  if (!_denseLayers.empty() && _denseDirty)
+    _evalDense();
+  return _outputs[index]->eval();
+}
 void MLP::setWeight(const double value, const int index) const {
-  static_cast<ConstantNode *>(_weights[index])->set(value);
+  if (!_pruned.empty() && _pruned[index])
+    return;
+  if (_denseLayers.empty()) {
+    static_cast<ConstantNode *>(_weights[index])->set(value);
+    return;
+  }
+  const auto [layer, i] = _denseWeight(index);
+  layer->setWeight(value, i);
+  _denseDirty = true;
+}
+int MLP::nbWeights() const {
+  if (_denseLayers.empty())
+    return static_cast<int>(_weights.size());
+  return _denseOffsets.back();
+}
+ComputeNode &MLP::getWeightNode(const int index) const {
+  assert(_denseLayers.empty() && "ERROR: dense layers have no weight nodes");
+  return *_weights[index];
+}
+double MLP::getWeight(const int index) const {
+  if (_denseLayers.empty())
+    return _weights[index]->eval();
+  const auto [layer, i] = _denseWeight(index);
+  return layer->getWeight(i);
 }
-int MLP::nbWeights() const { return static_cast<int>(_weights.size()); }
-double MLP::getWeight(const int index) const { return _weights[index]->eval(); }
 double MLP::getWeightDiff(const int index) const {
-  return _weights[index]->diff();
+  if (_denseLayers.empty())
+    return _weights[index]->diff();
+  const auto [layer, i] = _denseWeight(index);
+  return layer->getWeightDiff(i);
+}
+
+double MLP::getInputDiff(const int index) const {
+  if (_denseLayers.empty())
+    return _inputs[index]->diff();
+  return _denseInputDiffs[index];
 }
 
 void MLP::eval() const {
+  if (!_denseLayers.empty()) {
+    if (_denseDirty)
+      _evalDense();
+    return;
+  }
   for (int i = 0; i < _outputs.size(); ++i)
     getOutput(i);
 }
 
 void MLP::diff() const {
+  if (!_denseLayers.empty()) {
+    _diffDense();
+    return;
+  }
+  // Only cache hits after a forward pass, the partials are never stale
+  eval();
   for (ComputeNode *n : _inputs)
     n->diff();
 
@@ -78,4 +173,377 @@ void MLP::diff() const {
   // getWeightDiff(i);
 }
 
-} // namespace ml
\ No newline at end of file
+const std::vector<LayerBuilder> &MLP::topology() const { return _builders; }
+
+InferenceModel MLP::freeze(const Encoding *encoding) const {
+  std::vector<double> weights(nbWeights());
+  for (int i = 0; i < weights.size(); ++i)
+    weights[i] = getWeight(i);
+  return InferenceModel(_builders, weights, encoding);
+}
+
+std::vector<uint16_t> MLP::exportWeights(const HalfFormat format) const {
+  std::vector<float> values(nbWeights());
+  for (int i = 0; i < values.size(); ++i)
+    values[i] = static_cast<float>(getWeight(i));
+  std::vector<uint16_t> weights(values.size());
+  toHalf(format, static_cast<int>(values.size()), values.data(),
+         weights.data());
+  return weights;
+}
+
+void MLP::importWeights(const HalfFormat format,
+                        const std::vector<uint16_t> &weights) const {
+  assert(weights.size() == nbWeights() && "ERROR: unexpected weight count");
+  std::vector<float> values(weights.size());
+  fromHalf(format, static_cast<int>(weights.size()), weights.data(),
+           values.data());
+  for (int i = 0; i < values.size(); ++i)
+    setWeight(values[i], i);
+}
+
+// PRUNING
+int MLP::prune(const double threshold) {
+  for (const int i : connections(_builders))
+    if (std::abs(getWeight(i)) < threshold) {
+      // Set before the mask, which then keeps it
+      setWeight(0.0, i);
+      if (_pruned.empty())
+        _pruned.assign(nbWeights(), false);
+      _pruned[i] = true;
+    }
+  return nbPruned();
+}
+
+int MLP::pruneToSparsity(const double sparsity) {
+  assert(sparsity >= 0.0 && sparsity <= 1.0 &&
+         "ERROR: the sparsity is a fraction of the connections");
+  std::vector<std::pair<double, int>> magnitudes;
+  for (const int i : connections(_builders))
+    magnitudes.emplace_back(std::abs(getWeight(i)), i);
+  const int target = static_cast<int>(sparsity * magnitudes.size());
+  // The weights already pruned are 0, they come first
+  std::ranges::nth_element(magnitudes, magnitudes.begin() + target);
+  if (target > 0 && _pruned.empty())
+    _pruned.assign(nbWeights(), false);
+  for (int t = 0; t < target; ++t) {
+    const int i = magnitudes[t].second;
+    setWeight(0.0, i);
+    _pruned[i] = true;
+  }
+  return nbPruned();
+}
+
+bool MLP::isPruned(const int index) const {
+  return !_pruned.empty() && _pruned[index];
+}
+
+int MLP::nbPruned() const {
+  return static_cast<int>(std::ranges::count(_pruned, true));
+}
+
+int MLP::nbConnections() const {
+  return static_cast<int>(connections(_builders).size());
+}
+
+void MLP::clearPruning() { _pruned.clear(); }
+
+// ARCHITECTURE EDITS
+std::vector<int> MLP::insertLayer(const int index, const LayerBuilder &layer) {
+  assert(index > 0 && index < _builders.size() &&
+         "ERROR: a layer can only be inserted between the input and output");
+  assert(layer.backend == _builders[0].backend &&
+         "ERROR: graph and dense layers can't be mixed");
+  std::vector<LayerBuilder> layers = _builders;
+  layers.insert(layers.begin() + index, layer);
+  std::vector<int> origins(_builders.size());
+  std::iota(origins.begin(), origins.end(), 0);
+  origins.insert(origins.begin() + index, -1);
+  return _edit(layers, origins);
+}
+
+std::vector<int> MLP::removeLayer(const int index) {
+  assert(index > 0 && index + 1 < _builders.size() &&
+         "ERROR: only a hidden layer can be removed");
+  std::vector<LayerBuilder> layers = _builders;
+  layers.erase(layers.begin() + index);
+  std::vector<int> origins(_builders.size());
+  std::iota(origins.begin(), origins.end(), 0);
+  origins.erase(origins.begin() + index);
+  return _edit(layers, origins);
+}
+
+std::vector<int> MLP::resizeLayer(const int index, const int size) {
+  assert(index > 0 && index + 1 < _builders.size() &&
+         "ERROR: only a hidden layer can be resized");
+  assert(size > 0 && "ERROR: empty layer");
+  std::vector<LayerBuilder> layers = _builders;
+  layers[index].size = size;
+  std::vector<int> origins(_builders.size());
+  std::iota(origins.begin(), origins.end(), 0);
+  return _edit(layers, origins);
+}
+
+std::vector<int> MLP::setActivation(const int index,
+                                    const LayerBuilder::Type type) {
+  assert(index > 0 && index + 1 < _builders.size() &&
+         "ERROR: only a hidden layer can change its activation");
+  std::vector<LayerBuilder> layers = _builders;
+  layers[index].type = type;
+  std::vector<int> origins(_builders.size());
+  std::iota(origins.begin(), origins.end(), 0);
+  return _edit(layers, origins);
+}
+
+std::vector<int> MLP::_edit(const std::vector<LayerBuilder> &layers,
+                            const std::vector<int> &origins) {
+  const std::vector<LayerBuilder> old = _builders;
+  const int nbLayers = static_cast<int>(layers.size());
+  // Masked again once the weights are set
+  const std::vector<bool> oldPruned = std::move(_pruned);
+  _pruned.clear();
+  std::vector<double> oldWeights(nbWeights());
+  for (int i = 0; i < oldWeights.size(); ++i)
+    oldWeights[i] = getWeight(i);
+  std::vector<int> oldFirst(old.size() + 1, 0);
+  for (int l = 0; l < old.size(); ++l)
+    oldFirst[l + 1] = oldFirst[l] + old[l].size * rowSize(old, l);
+
+  // New neurons for the new and changed layers, all new inputs for the
+  // layers after them or after a removed one. A resized layer only adds or
+  // removes its last neurons, the next one their inputs.
+  std::vector<bool> rebuilt(nbLayers), resized(nbLayers), rewired(nbLayers);
+  std::vector<bool> touched(nbLayers);
+  for (int l = 0; l < nbLayers; ++l) {
+    const int o = origins[l];
+    rebuilt[l] = o < 0 || layers[l].type != old[o].type ||
+                 layers[l].bias != old[o].bias;
+    resized[l] = !rebuilt[l] && layers[l].size != old[o].size;
+    rewired[l] = l > 0 && (rebuilt[l] || rebuilt[l - 1] ||
+                           origins[l - 1] != o - 1);
+    touched[l] = rewired[l] || resized[l] || (l > 0 && resized[l - 1]);
+  }
+  assert(!rebuilt.front() && !rebuilt.back() && !resized.front() &&
+         !resized.back() &&
+         "ERROR: the input and output layers can't be edited");
+
+  if (_denseLayers.empty()) {
+    std::vector<Layer *> newLayers(nbLayers, nullptr);
+    for (int l = 0; l < nbLayers; ++l)
+      if (!rebuilt[l])
+        newLayers[l] = _layers[origins[l]];
+    // The layers left out remove their nodes, and the edges to the next one
+    for (const Layer *layer : _layers)
+      if (std::ranges::find(newLayers, layer) == newLayers.end())
+        delete layer;
+    for (int l = 0; l < nbLayers; ++l) {
+      if (rebuilt[l])
+        newLayers[l] = LayerBuilder(layers[l]).build(*this).release();
+      else if (resized[l])
+        newLayers[l]->resize(layers[l].size);
+    }
+    // Weights are set below, the connections are made with 0
+    for (int l = 1; l < nbLayers; ++l) {
+      const Layer &prev = *newLayers[l - 1];
+      const Layer &layer = *newLayers[l];
+      const int bias = layers[l].bias ? 1 : 0;
+      if (rewired[l]) {
+        if (!rebuilt[l])
+          layer.removeInputs(bias);
+        prev.connectToLayer(layer, l == 1);
+        continue;
+      }
+      const int kept = std::min(layer.size(), old[origins[l]].size);
+      const int prevOld = old[origins[l - 1]].size;
+      const int prevKept = std::min(prevOld, prev.size());
+      if (resized[l - 1])
+        for (int j = 0; j < kept; ++j) {
+          layer.getNeuron(j).removeInputs(bias + prevKept);
+          for (int i = prevOld; i < prev.size(); ++i)
+            prev.getNeuron(i).connectToNeuron(layer.getNeuron(j), 0.0);
+        }
+      for (int j = kept; j < layer.size(); ++j)
+        for (int i = 0; i < prev.size(); ++i)
+          prev.getNeuron(i).connectToNeuron(layer.getNeuron(j), 0.0);
+    }
+    _layers = std::move(newLayers);
+    _collectWeights();
+  } else {
+    std::vector<std::unique_ptr<DenseLayer>> newLayers(nbLayers);
+    for (int l = 0; l < nbLayers; ++l)
+      newLayers[l] =
+          touched[l] ? std::make_unique<DenseLayer>(layers[l - 1].size,
+                                                    layers[l].size,
+                                                    layers[l].type,
+                                                    layers[l].bias)
+                     : std::move(_denseLayers[origins[l]]);
+    _denseLayers = std::move(newLayers);
+    _updateDenseOffsets();
+    _denseDirty = true;
+  }
+  _builders = layers;
+
+  // Weights of the reconnected layers, copied while they fit
+  std::vector<int> result(nbWeights(), -1);
+  int first = 0;
+  for (int l = 0; l < nbLayers; ++l) {
+    const LayerBuilder &b = layers[l];
+    const int o = origins[l];
+    const int row = rowSize(layers, l);
+    if (!touched[l]) {
+      std::iota(result.begin() + first, result.begin() + first + b.size * row,
+                oldFirst[o]);
+      first += b.size * row;
+      continue;
+    }
+    const int bias = b.bias ? 1 : 0;
+    const int nbInputs = layers[l - 1].size;
+    const int oldSize = o < 0 ? 0 : old[o].size;
+    const int oldRow = o < 0 ? 0 : rowSize(old, o);
+    const int oldBias = o >= 0 && old[o].bias ? 1 : 0;
+    // After a removed layer the inputs come from another layer, only the
+    // biases are kept
+    const bool samePrev = o >= 0 && origins[l - 1] == o - 1;
+    const bool identity = b.type == LayerBuilder::Type::ReLu ||
+                          b.type == LayerBuilder::Type::Identity;
+    std::normal_distribution<double> biasDist{
+        0.0, std::sqrt(2.0 / static_cast<double>(b.size))};
+    std::normal_distribution<double> inputDist{
+        0.0, std::sqrt(2.0 / static_cast<double>(nbInputs))};
+    for (int j = 0; j < b.size; ++j) {
+      for (int c = 0; c < row; ++c) {
+        // Column -1 is the bias
+        const int k = c - bias;
+        const int index = first + j * row + c;
+        double w;
+        if (j < oldSize && (k < 0 || samePrev)) {
+          // An input that didn't exist has no effect yet
+          const int from = k < 0 ? (oldBias ? 0 : -1)
+                           : k < oldRow - oldBias ? oldBias + k
+                                                  : -1;
+          if (from >= 0)
+            result[index] = oldFirst[o] + j * oldRow + from;
+          w = from >= 0 ? oldWeights[result[index]] : 0.0;
+        } else if (o < 0 && identity && j < nbInputs)
+          w = k == j ? 1.0 : 0.0;
+        else if (k < 0)
+          w = Random::get(biasDist);
+        else
+          w = b.type == LayerBuilder::Type::Sine ? sirenWeight(nbInputs, l == 1)
+                                                 : Random::get(inputDist);
+        setWeight(w, index);
+      }
+    }
+    first += b.size * row;
+  }
+  if (!oldPruned.empty()) {
+    _pruned.assign(result.size(), false);
+    for (int i = 0; i < result.size(); ++i)
+      _pruned[i] = result[i] >= 0 && oldPruned[result[i]];
+  }
+  return result;
+}
+
+// DENSE BACKEND
+void MLP::_buildDense(const std::vector<LayerBuilder> &layers) {
+  for (int l = 0; l < layers.size(); ++l) {
+    const LayerBuilder &b = layers[l];
+    assert(b.backend == LayerBuilder::Backend::Dense &&
+           "ERROR: graph and dense layers can't be mixed");
+    const int nbInputs = l == 0 ? 0 : layers[l - 1].size;
+    _denseLayers.push_back(
+        std::make_unique<DenseLayer>(nbInputs, b.size, b.type, b.bias));
+  }
+
+  // Same draws in the same order as the graph layers: the biases of each
+  // layer, then the connections between consecutive layers
+  for (const auto &layer : _denseLayers) {
+    if (!layer->hasBias())
+      continue;
+    std::normal_distribution<double> d{
+        0.0, std::sqrt(2.0 / static_cast<double>(layer->size()))};
+    const int stride = layer->nbInputs() + 1;
+    for (int j = 0; j < layer->size(); ++j)
+      layer->setWeight(Random::get(d), j * stride);
+  }
+  for (int l = 0; l + 1 < _denseLayers.size(); ++l) {
+    DenseLayer &next = *_denseLayers[l + 1];
+    const int size = _denseLayers[l]->size();
+    std::normal_distribution<double> d{
+        0.0, std::sqrt(2.0 / static_cast<double>(size))};
+    const bool siren = next.type() == LayerBuilder::Type::Sine;
+    const int bias = next.hasBias() ? 1 : 0;
+    for (int i = 0; i < size; ++i)
+      for (int j = 0; j < next.size(); ++j)
+        next.setWeight(siren ? sirenWeight(size, l == 0) : Random::get(d),
+                       j * (size + bias) + bias + i);
+  }
+
+  _updateDenseOffsets();
+
+  for (int i = 0; i < _denseLayers.front()->size(); ++i) {
+    ConstantNode &n = ComputeSubGraph::nodeFactory().createConstantNode(0);
+    n.setLabelPrefix("I: ");
+    _inputs.push_back(&n);
+  }
+  for (int i = 0; i < _denseLayers.back()->size(); ++i) {
+    ConstantNode &n = ComputeSubGraph::nodeFactory().createConstantNode(0);
+    n.setLabelPrefix("O: ");
+    _outputs.push_back(&n);
+  }
+}
+
+void MLP::_updateDenseOffsets() {
+  _denseOffsets = {0};
+  for (const auto &layer : _denseLayers)
+    _denseOffsets.push_back(_denseOffsets.back() + layer->nbWeights());
+}
+
+std::vector<double> MLP::_denseInputs() const {
+  std::vector<double> inputs(_inputs.size());
+  for (int i = 0; i < _inputs.size(); ++i)
+    inputs[i] = _inputs[i]->eval();
+  return inputs;
+}
+
+std::pair<DenseLayer *, int> MLP::_denseWeight(const int index) const {
+  const auto it =
+      std::upper_bound(_denseOffsets.begin(), _denseOffsets.end(), index);
+  const int l = static_cast<int>(it - _denseOffsets.begin()) - 1;
+  return {_denseLayers[l].get(), index - _denseOffsets[l]};
+}
+
+void MLP::_evalDense() const {
+  const std::vector<double> inputs = _denseInputs();
+  const double *x = inputs.data();
+  for (const auto &layer : _denseLayers) {
+    layer->forward(x);
+    x = layer->output();
+  }
+  for (int i = 0; i < _outputs.size(); ++i)
+    static_cast<ConstantNode *>(_outputs[i])->set(x[i]);
+  _denseDirty = false;
+}
+
+void MLP::_diffDense() const {
+  if (_denseDirty)
+    _evalDense();
+  // The gradient enters through the output constants, whatever uses them
+  std::vector<double> outputDiff(_outputs.size());
+  for (int i = 0; i < _outputs.size(); ++i)
+    outputDiff[i] = _outputs[i]->diff();
+
+  const std::vector<double> inputs = _denseInputs();
+  std::vector<double> inputDiff;
+  for (int l = static_cast<int>(_denseLayers.size()) - 1; l >= 0; --l) {
+    DenseLayer &layer = *_denseLayers[l];
+    const double *x = l == 0 ? inputs.data() : _denseLayers[l - 1]->output();
+    // The input layer takes one value per neuron
+    inputDiff.assign(l == 0 ? layer.size() : layer.nbInputs(), 0.0);
+    layer.backward(x, outputDiff.data(), inputDiff.data());
+    std::swap(outputDiff, inputDiff);
+  }
+  _denseInputDiffs = std::move(outputDiff);
+}
+
+} // namespace ml
@@ -12,6 +12,7 @@ void Neuron::addInput(ComputeNode &node, const bool addWeight,
     weightNodde.setLabelPrefix("W: ");
     _inputWeights.push_back(&weightNodde);
     MultNode &m = nodeFactory().createMultNode();
+    _inputMults.push_back(&m);
     createEdge(weightNodde, m, 0);
     createEdge(node, m, 1);
     _aggregate->addInput(m);
@@ -22,6 +23,15 @@ void Neuron::addInput(ComputeNode &node, const bool addWeight,
 void Neuron::connectToNeuron(Neuron &other, double weight) const {
   other.addInput(output(), true, weight);
 }
+void Neuron::removeInputs(const int first) {
+  // From the last one, the most recent nodes of the neuron
+  while (_inputWeights.size() > first) {
+    removeNode(*_inputMults.back());
+    removeNode(*_inputWeights.back());
+    _inputMults.pop_back();
+    _inputWeights.pop_back();
+  }
+}
 ComputeNode &Neuron::getWeight(const int index) const {
   return *_inputWeights[index];
 }
@@ -45,4 +55,11 @@ NeuronSigmoid::NeuronSigmoid(IComputeGraph &graph) : Neuron(graph) {
   _activation->setInput(_aggregate->output());
 }
 
+NeuronSine::NeuronSine(IComputeGraph &graph, const double omega)
+    : Neuron(graph) {
+  _aggregate = std::make_unique<SumAggregate>(*this);
+  _activation = std::make_unique<SineActivation>(*this, omega);
+  _activation->setInput(_aggregate->output());
+}
+
 } // namespace ml
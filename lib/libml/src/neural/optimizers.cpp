@@ -10,6 +10,19 @@ using Random = effolkronium::random_static;
 
 namespace ml {
 
+namespace {
+// State of each weight at its new index, the new weights start from scratch
+template <class T>
+std::vector<T> remapped(const std::vector<T> &state,
+                        const std::vector<int> &origins) {
+  std::vector<T> result(origins.size());
+  for (int i = 0; i < origins.size(); ++i)
+    if (origins[i] >= 0)
+      result[i] = state[origins[i]];
+  return result;
+}
+} // namespace
+
 // ContinuousMean
 //------------------------------------------------------------------------------
 void ContinuousMean::add(const double value) {
@@ -45,16 +58,40 @@ Optimizer::Optimizer(MLP &mlp, std::unique_ptr<Loss> loss)
   }
 }
 
-void Optimizer::setDataset(DataSet &dataSet) { _dataSet = &dataSet; }
+void Optimizer::setDataset(DataSet &dataSet) {
+  _dataSet = &dataSet;
+  if (_encoding)
+    _encoding->setDataSet(dataSet);
+}
+
+void Optimizer::setEncoding(Encoding *encoding) {
+  assert((!encoding || encoding->nbOutputs() == _mlp.nbInputs()) &&
+         "ERROR: the encoding doesn't match the mlp inputs");
+  _encoding = encoding;
+  if (encoding) {
+    _encodingInput.resize(encoding->nbInputs());
+    _encodingOutput.resize(encoding->nbOutputs());
+    if (_dataSet)
+      encoding->setDataSet(*_dataSet);
+  }
+}
 
 void Optimizer::_forward() {
   assert(_dataSet != nullptr && "ERROR: no DataSet");
 
   const int index = nextTrainingIndex();
   // Set inputs of MLP
-  for (int i = 0; i < _dataSet->inputTable().width(); ++i) {
-    const double v = _dataSet->inputTable().get(index, i);
-    _mlp.setInput(v, i);
+  if (_encoding) {
+    for (int i = 0; i < _encoding->nbInputs(); ++i)
+      _encodingInput[i] = _dataSet->inputTable().get(index, i);
+    _encoding->encodeSample(*_dataSet, index, _encodingOutput.data());
+    for (int i = 0; i < _mlp.nbInputs(); ++i)
+      _mlp.setInput(_encodingOutput[i], i);
+  } else {
+    for (int i = 0; i < _dataSet->inputTable().width(); ++i) {
+      const double v = _dataSet->inputTable().get(index, i);
+      _mlp.setInput(v, i);
+    }
   }
   // Set true values for the loss
   for (int i = 0; i < _dataSet->outputTable().width(); ++i) {
@@ -62,11 +99,66 @@ void Optimizer::_forward() {
     static_cast<ConstantNode *>(_trueValues[i])->set(v);
   }
 
-  // We eval the mlp with the loss !
+  if (_compile()) {
+    _compiled->pull();
+    _compiled->forward();
+    _loss->loss = _compiled->value(_lossIndex);
+    return;
+  }
+  // We eval the mlp with the loss ! (dense layers are evaluated first)
+  _mlp.eval();
   _loss->loss = _loss->output().eval();
 }
 
-void Optimizer::_backward() const { _mlp.diff(); }
+void Optimizer::_backward() {
+  // Pushed from the loss, the cone behind a zero adjoint is skipped
+  // Partials of the node graph are read from the last forward pass, which
+  // must have reached the loss
+  if (_compiled) {
+    _compiled->backward();
+  } else {
+    _loss->output().eval();
+    _mlp.diff();
+  }
+  if (!_encoding)
+    return;
+  // Reuses the output buffer, the encoded values aren't needed anymore
+  for (int i = 0; i < _mlp.nbInputs(); ++i)
+    _encodingOutput[i] = _inputDiff(i);
+  _encoding->backward(_encodingInput.data(), _encodingOutput.data());
+}
+
+bool Optimizer::_compile() {
+  if (_mlp.topology().front().backend == LayerBuilder::Backend::Dense)
+    return false;
+  if (_compiled && _compiledVersion == rootGraph().version())
+    return true;
+  _compiled.emplace(
+      std::vector<std::reference_wrapper<ComputeNode>>{_loss->output()});
+  _compiledVersion = rootGraph().version();
+  _lossIndex = _compiled->indexOf(_loss->output());
+  _weightIndices.resize(_mlp.nbWeights());
+  for (int i = 0; i < _weightIndices.size(); ++i)
+    _weightIndices[i] = _compiled->indexOf(_mlp.getWeightNode(i));
+  _inputIndices.resize(_mlp.nbInputs());
+  for (int i = 0; i < _inputIndices.size(); ++i)
+    _inputIndices[i] = _compiled->indexOf(_mlp.getInputNode(i));
+  return true;
+}
+
+double Optimizer::_weightDiff(const int index) const {
+  if (!_compiled)
+    return _mlp.getWeightDiff(index);
+  const int w = _weightIndices[index];
+  return w < 0 ? 0.0 : _compiled->adjoint(w);
+}
+
+double Optimizer::_inputDiff(const int index) const {
+  if (!_compiled)
+    return _mlp.getInputDiff(index);
+  const int in = _inputIndices[index];
+  return in < 0 ? 0.0 : _compiled->adjoint(in);
+}
 
 void Optimizer::setLoss(std::unique_ptr<Loss> loss) {
   _loss.reset();
@@ -87,11 +179,16 @@ BatchOptimizer::BatchOptimizer(MLP &mlp, std::unique_ptr<Loss> loss,
 
 int BatchOptimizer::nextTrainingIndex() { return _currentInput; }
 
+void BatchOptimizer::remapWeights(const std::vector<int> &origins) {
+  _previousUpdate = remapped(_previousUpdate, origins);
+  _avgGradient = remapped(_avgGradient, origins);
+}
+
 bool BatchOptimizer::optimize() {
   _forward();
   _backward();
   for (int i = 0; i < _mlp.nbWeights(); ++i)
-    _avgGradient[i].add(_mlp.getWeightDiff(i));
+    _avgGradient[i].add(_weightDiff(i));
 
   // Next input
   ++_currentInput;
@@ -123,7 +220,7 @@ SGDOptimizer::SGDOptimizer(MLP &mlp, std::unique_ptr<Loss> loss,
       nesterov(nesterov), _randomGenerator(_randomDevice()) {}
 
 void SGDOptimizer::setDataset(DataSet &dataSet) {
-  _dataSet = &dataSet;
+  Optimizer::setDataset(dataSet);
   _indices = std::vector<int>(dataSet.size());
   for (int i = 0; i < _indices.size(); ++i)
     _indices[i] = i;
@@ -132,6 +229,10 @@ void SGDOptimizer::setDataset(DataSet &dataSet) {
 
 int SGDOptimizer::nextTrainingIndex() { return _indices[_currentInput]; }
 
+void SGDOptimizer::remapWeights(const std::vector<int> &origins) {
+  _previousUpdate = remapped(_previousUpdate, origins);
+}
+
 bool SGDOptimizer::optimize() {
   _forward();
   _backward();
@@ -143,10 +244,15 @@ bool SGDOptimizer::optimize() {
     Random::shuffle(_indices);
   }
 
+  // Setting a weight invalidates the graph, every gradient is read first
+  _gradient.resize(_mlp.nbWeights());
+  for (int i = 0; i < _mlp.nbWeights(); ++i)
+    _gradient[i] = _weightDiff(i);
+
   // Apply new weight values from the gradient
   for (int i = 0; i < _mlp.nbWeights(); ++i) {
     double newWeight = _mlp.getWeight(i);
-    const double g = _mlp.getWeightDiff(i);
+    const double g = _gradient[i];
     if (nesterov)
       newWeight +=
           momentum * (momentum * _previousUpdate[i] - learningRate * g) -
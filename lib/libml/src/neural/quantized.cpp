@@ -0,0 +1,119 @@
+#include "libml/neural/quantized.h"
+
+#include "libml/compute/kernels.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace ml {
+
+namespace {
+// Nearest integer within [-127, 127]
+int16_t quantize(const double x) {
+  // Adding then removing 1.5 * 2^52 rounds to the nearest integer
+  const double r = std::clamp(x, -127.0, 127.0) + 6755399441055744.0;
+  return static_cast<int16_t>(r - 6755399441055744.0);
+}
+
+// Scale that maps the largest magnitude to 127
+double scaleOf(const double maxAbs) {
+  return maxAbs > 0.0 ? maxAbs / 127.0 : 1.0;
+}
+} // namespace
+
+QuantizedMLP::QuantizedMLP(const InferenceModel &model,
+                           const DataSet &dataSet, const int nbSamples)
+    : _encoding(model.encoding()), _nbInputs(model.nbInputs()),
+      _first(model.layers().front()) {
+  assert(nbSamples > 0 && "ERROR: no calibration sample");
+  assert(dataSet.inputTable().width() == nbInputs() &&
+         "ERROR: the dataset doesn't match the model inputs");
+  const std::vector<InferenceLayer> &layers = model.layers();
+  for (int l = 1; l < layers.size(); ++l)
+    _layers.push_back({layers[l].nbInputs, layers[l].size, layers[l].type,
+                       {}, layers[l].biases, 1.0, 1.0});
+
+  // Largest input of each layer over the calibration samples
+  std::vector<double> maxInputs(_layers.size(), 0.0);
+  std::vector<float> coords(nbInputs());
+  std::vector<double> values, next;
+  const int step = std::max(1, dataSet.size() / nbSamples);
+  for (int s = 0; s < dataSet.size(); s += step) {
+    for (int i = 0; i < nbInputs(); ++i)
+      coords[i] = static_cast<float>(dataSet.inputTable().get(s, i));
+    values.resize(_first.size);
+    inputValues(_encoding.get(), _first, nbInputs(), coords.data(),
+                values.data());
+    activate(_first.type, values.data(), _first.size);
+    for (int l = 0; l < _layers.size(); ++l) {
+      const InferenceLayer &layer = layers[l + 1];
+      for (const double v : values)
+        maxInputs[l] = std::max(maxInputs[l], std::abs(v));
+      next.resize(layer.size);
+      gemv(layer.size, layer.nbInputs, layer.weights.data(), values.data(),
+           layer.biases.data(), next.data());
+      std::swap(values, next);
+      activate(layer.type, values.data(), layer.size);
+    }
+  }
+
+  for (int l = 0; l < _layers.size(); ++l) {
+    Layer &layer = _layers[l];
+    const std::vector<double> &weights = layers[l + 1].weights;
+    double maxWeight = 0.0;
+    for (const double w : weights)
+      maxWeight = std::max(maxWeight, std::abs(w));
+    layer.weightScale = scaleOf(maxWeight);
+    layer.inputScale = scaleOf(maxInputs[l]);
+    std::vector<int8_t> rows(weights.size());
+    for (int i = 0; i < rows.size(); ++i)
+      rows[i] = static_cast<int8_t>(quantize(weights[i] / layer.weightScale));
+    layer.weights.resize(packedInt8Size(layer.size, layer.nbInputs));
+    packInt8(layer.size, layer.nbInputs, rows.data(), layer.weights.data());
+  }
+}
+
+int QuantizedMLP::nbInputs() const { return _nbInputs; }
+int QuantizedMLP::nbOutputs() const { return _layers.back().size; }
+
+int QuantizedMLP::nbBytes() const {
+  int total = 0;
+  for (const Layer &layer : _layers)
+    total += static_cast<int>(layer.weights.size());
+  return total;
+}
+
+void QuantizedMLP::evaluate(const std::span<const float> coords,
+                            const std::span<float> rgb) const {
+  const int batch = static_cast<int>(coords.size()) / nbInputs();
+  assert(batch * nbInputs() == coords.size() &&
+         "ERROR: partial sample in the coordinates");
+  assert(batch * nbOutputs() == rgb.size() &&
+         "ERROR: the outputs don't match the coordinates");
+  int width = _first.size;
+  for (const Layer &layer : _layers)
+    width = std::max(width, layer.size);
+  std::vector<double> values(width);
+  std::vector<int16_t> quantized(width);
+  std::vector<int32_t> sums(width);
+  for (int s = 0; s < batch; ++s) {
+    inputValues(_encoding.get(), _first, nbInputs(),
+                coords.data() + s * nbInputs(), values.data());
+    activate(_first.type, values.data(), _first.size);
+    for (const Layer &layer : _layers) {
+      const double inverse = 1.0 / layer.inputScale;
+      for (int i = 0; i < layer.nbInputs; ++i)
+        quantized[i] = quantize(values[i] * inverse);
+      gemvInt8(layer.size, layer.nbInputs, layer.weights.data(),
+               quantized.data(), sums.data());
+      const double scale = layer.weightScale * layer.inputScale;
+      for (int j = 0; j < layer.size; ++j)
+        values[j] = sums[j] * scale + layer.biases[j];
+      activate(layer.type, values.data(), layer.size);
+    }
+    std::copy_n(values.data(), nbOutputs(), rgb.begin() + s * nbOutputs());
+  }
+}
+
+} // namespace ml
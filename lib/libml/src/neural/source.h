@@ -0,0 +1,44 @@
+#pragma once
+
+// Helpers to write standalone C++ source, see InferenceModel::writeSource()
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ml {
+
+// Float literal with 9 significant digits, enough for any float to read
+// back the same. NaN and the infinities, also from doubles out of the float
+// range, have no literal: they are written as std::numeric_limits calls.
+inline std::string floatLiteral(const double value) {
+  const float f = static_cast<float>(value);
+  if (std::isnan(f))
+    return "std::numeric_limits<float>::quiet_NaN()";
+  if (std::isinf(f))
+    return f > 0 ? "std::numeric_limits<float>::infinity()"
+                 : "-std::numeric_limits<float>::infinity()";
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "%.9g", f);
+  std::string literal = buffer;
+  if (!std::strpbrk(buffer, ".e"))
+    literal += ".0";
+  return literal + "f";
+}
+
+// inline constexpr float name[values.size()] = {...};
+inline void writeFloatArray(std::ostream &out, const std::string &name,
+                            const std::vector<double> &values) {
+  constexpr int PER_LINE = 4;
+  out << "inline constexpr float " << name << "[" << values.size()
+      << "] = {";
+  for (int i = 0; i < values.size(); ++i)
+    out << (i % PER_LINE == 0 ? "\n    " : " ") << floatLiteral(values[i])
+        << (i + 1 < values.size() ? "," : "");
+  out << "};\n";
+}
+
+} // namespace ml
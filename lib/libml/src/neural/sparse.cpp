@@ -0,0 +1,91 @@
+#include "libml/neural/sparse.h"
+
+#include "libml/compute/kernels.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace ml {
+
+SparseMLP::SparseMLP(const InferenceModel &model)
+    : _encoding(model.encoding()), _nbInputs(model.nbInputs()),
+      _first(model.layers().front()) {
+  const std::vector<InferenceLayer> &layers = model.layers();
+  for (int l = 1; l < layers.size(); ++l) {
+    const InferenceLayer &source = layers[l];
+    Layer layer{source.nbInputs, source.size, source.type, 0, {0}, {}, {},
+                source.biases};
+    // Nonzero weights of each neuron with their input
+    std::vector<std::vector<std::pair<int, double>>> rows(source.size);
+    for (int j = 0; j < source.size; ++j) {
+      for (int k = 0; k < source.nbInputs; ++k) {
+        const double w = source.weights[j * source.nbInputs + k];
+        if (w != 0.0)
+          rows[j].emplace_back(k, w);
+      }
+      layer.nbNonZeros += static_cast<int>(rows[j].size());
+    }
+    // The padding multiplies 0 with the first input
+    for (int j = 0; j < source.size; j += SPARSE_SLICE) {
+      const int end = std::min(source.size, j + SPARSE_SLICE);
+      std::size_t length = 0;
+      for (int t = j; t < end; ++t)
+        length = std::max(length, rows[t].size());
+      for (int p = 0; p < length; ++p)
+        for (int t = j; t < j + SPARSE_SLICE; ++t) {
+          const bool set = t < end && p < rows[t].size();
+          layer.columns.push_back(set ? rows[t][p].first : 0);
+          layer.values.push_back(set ? rows[t][p].second : 0.0);
+        }
+      layer.offsets.push_back(static_cast<int>(layer.values.size()));
+    }
+    _layers.push_back(std::move(layer));
+  }
+}
+
+int SparseMLP::nbInputs() const { return _nbInputs; }
+int SparseMLP::nbOutputs() const { return _layers.back().size; }
+
+int SparseMLP::nbNonZeros() const {
+  int total = 0;
+  for (const Layer &layer : _layers)
+    total += layer.nbNonZeros;
+  return total;
+}
+
+int SparseMLP::nbBytes() const {
+  int total = static_cast<int>(_first.biases.size() * sizeof(double));
+  for (const Layer &layer : _layers)
+    total += static_cast<int>(
+        (layer.offsets.size() + layer.columns.size()) * sizeof(int) +
+        (layer.values.size() + layer.biases.size()) * sizeof(double));
+  return total;
+}
+
+void SparseMLP::evaluate(const std::span<const float> coords,
+                         const std::span<float> rgb) const {
+  const int batch = static_cast<int>(coords.size()) / nbInputs();
+  assert(batch * nbInputs() == coords.size() &&
+         "ERROR: partial sample in the coordinates");
+  assert(batch * nbOutputs() == rgb.size() &&
+         "ERROR: the outputs don't match the coordinates");
+  int width = _first.size;
+  for (const Layer &layer : _layers)
+    width = std::max(width, layer.size);
+  std::vector<double> values(width), next(width);
+  for (int s = 0; s < batch; ++s) {
+    inputValues(_encoding.get(), _first, nbInputs(),
+                coords.data() + s * nbInputs(), values.data());
+    activate(_first.type, values.data(), _first.size);
+    for (const Layer &layer : _layers) {
+      sparseGemv(layer.size, layer.offsets.data(), layer.columns.data(),
+                 layer.values.data(), values.data(), layer.biases.data(),
+                 next.data());
+      std::swap(values, next);
+      activate(layer.type, values.data(), layer.size);
+    }
+    std::copy_n(values.data(), nbOutputs(), rgb.begin() + s * nbOutputs());
+  }
+}
+
+} // namespace ml
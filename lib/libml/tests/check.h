@@ -0,0 +1,25 @@
+#pragma once
+
+// Helpers of the checks: each failed check is printed and counted, main()
+// returns failures == 0 ? 0 : 1
+
+#include <cmath>
+#include <cstdio>
+
+inline int failures = 0;
+
+inline void check(const bool condition, const char *what, const int index) {
+  if (condition)
+    return;
+  std::printf("FAILED: %s (%d)\n", what, index);
+  ++failures;
+}
+
+// Relative to the magnitude of both values
+inline bool near(const double a, const double b) {
+  return std::abs(a - b) <= 1e-9 * (1.0 + std::abs(a) + std::abs(b));
+}
+
+inline bool near(const double a, const double b, const double tolerance) {
+  return std::abs(a - b) <= tolerance;
+}
@@ -0,0 +1,95 @@
+// CompactGraph forward and backward sweeps against ComputeNode::eval() and
+// diff(), and clones evaluated on their own values, also once the graph
+// they were compiled from is destroyed
+
+#include "libml/compute/compact.h"
+#include "libml/neural/losses.h"
+#include "libml/neural/mlp.h"
+
+#include "check.h"
+
+#include <optional>
+
+using namespace ml;
+
+namespace {
+void checkActivation(const LayerBuilder::Type type) {
+  ComputeGraph graph;
+  MLP mlp(graph, {LayerBuilder(2, LayerBuilder::Type::Identity, false),
+                  LayerBuilder(8, type, true),
+                  LayerBuilder(8, type, true),
+                  LayerBuilder(3, LayerBuilder::Type::Identity, false)});
+  MSELoss loss(mlp);
+  std::vector<ConstantNode *> targets;
+  for (int i = 0; i < mlp.nbOutputs(); ++i) {
+    targets.push_back(&graph.nodeFactory().createConstantNode(0.1 * i));
+    loss.addInput(mlp.getOutputNode(i), *targets.back());
+  }
+  mlp.setInput(0.3, 0);
+  mlp.setInput(-0.6, 1);
+
+  CompactGraph compiled({loss.output()});
+  compiled.pull();
+  CompactGraph clone = compiled.clone();
+  check(clone.sharesValuesWith(compiled), "clone copied the values", 0);
+  compiled.forward();
+  check(!clone.sharesValuesWith(compiled), "forward() wrote shared values", 0);
+  compiled.backward();
+
+  const int output = compiled.indexOf(loss.output());
+  check(near(compiled.value(output), loss.output().eval()),
+        "forward() differs from eval()", output);
+  for (int i = 0; i < mlp.nbInputs(); ++i) {
+    const int in = compiled.indexOf(mlp.getInputNode(i));
+    check(near(compiled.adjoint(in), mlp.getInputNode(i).diff()),
+          "backward() differs from diff()", i);
+  }
+
+  // The clone shares the records but not the values
+  const int input = clone.indexOf(mlp.getInputNode(0));
+  clone.setValue(input, 0.9);
+  clone.forward();
+  check(clone.sharesRecordsWith(compiled), "clone copied the records", 0);
+  check(near(compiled.value(output), loss.output().eval()),
+        "evaluating a clone changed the original", output);
+  mlp.setInput(0.9, 0);
+  check(near(clone.value(output), loss.output().eval()),
+        "clone forward() differs from eval()", output);
+  check(clone.sourceId(output) == loss.output().id(),
+        "clone sourceId() differs", output);
+}
+
+// A clone keeps evaluating once the graph it was compiled from is gone
+void checkCloneOutlivesGraph() {
+  std::optional<CompactGraph> clone;
+  int input = -1, output = -1;
+  double expected = 0.0;
+  {
+    ComputeGraph graph;
+    MLP mlp(graph, {LayerBuilder(1, LayerBuilder::Type::Identity, false),
+                    LayerBuilder(4, LayerBuilder::Type::Sigmoid, true),
+                    LayerBuilder(1, LayerBuilder::Type::Identity, false)});
+    mlp.setInput(0.4, 0);
+    CompactGraph compiled({mlp.getOutputNode(0)});
+    compiled.pull();
+    clone.emplace(compiled.clone());
+    input = compiled.indexOf(mlp.getInputNode(0));
+    output = compiled.indexOf(mlp.getOutputNode(0));
+    expected = mlp.getOutputNode(0).eval();
+  }
+  clone->setValue(input, 0.4);
+  clone->forward();
+  clone->label(output);
+  check(near(clone->value(output), expected),
+        "clone forward() after the graph was destroyed", output);
+}
+} // namespace
+
+int main() {
+  checkActivation(LayerBuilder::Type::ReLu);
+  checkActivation(LayerBuilder::Type::Sigmoid);
+  checkActivation(LayerBuilder::Type::Sine);
+  checkActivation(LayerBuilder::Type::Identity);
+  checkCloneOutlivesGraph();
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,68 @@
+// SymbolicGradient against ComputeNode::diff(), which must stay the
+// derivative of the forward output once the gradient nodes exist
+
+#include "libml/compute/gradient.h"
+
+#include "check.h"
+
+using namespace ml;
+
+namespace {
+std::vector<double> diffs(const std::vector<ConstantNode *> &weights) {
+  std::vector<double> result;
+  for (ConstantNode *w : weights)
+    result.push_back(w->diff());
+  return result;
+}
+} // namespace
+
+int main() {
+  // One hidden neuron per activation and a squared error, like a training
+  // step of a small MLP
+  ComputeGraph graph;
+  NodeFactory &f = graph.nodeFactory();
+  ConstantNode &x = f.createConstantNode(0.3);
+  std::vector<ConstantNode *> weights;
+  const auto weighted = [&](ComputeNode &input, const double value) {
+    weights.push_back(&f.createConstantNode(value));
+    MultNode &m = f.createMultNode();
+    graph.createEdge(*weights.back(), m, {});
+    graph.createEdge(input, m, {});
+    return &m;
+  };
+  const std::vector<ComputeNode *> activations = {
+      &f.createReLUNode(), &f.createSigmoidNode(), &f.createSineNode(30.0),
+      &f.createExpNode()};
+  AddNode &output = f.createAddNode();
+  for (int i = 0; i < activations.size(); ++i) {
+    AddNode &sum = f.createAddNode();
+    graph.createEdge(*weighted(x, 0.4 - 0.2 * i), sum, {});
+    graph.createEdge(*weighted(graph.nodeAt(0), 0.1), sum, {});
+    graph.createEdge(sum, *activations[i], {});
+    graph.createEdge(*weighted(*activations[i], 0.5 + 0.1 * i), output, {});
+  }
+  ConstantNode &target = f.createConstantNode(0.8);
+  SubNode &error = f.createSubNode();
+  graph.createEdge(output, error, 0);
+  graph.createEdge(target, error, 1);
+  CtePowerNode &loss = f.createCtePowerNode(2);
+  graph.createEdge(error, loss, {});
+
+  loss.eval();
+  const std::vector<double> before = diffs(weights);
+
+  std::vector<std::reference_wrapper<ComputeNode>> wrt;
+  for (ConstantNode *w : weights)
+    wrt.emplace_back(*w);
+  const SymbolicGradient gradient(graph, loss, wrt);
+
+  // The gradient nodes invalidated the caches when they were connected
+  loss.eval();
+  const std::vector<double> after = diffs(weights);
+  for (int i = 0; i < weights.size(); ++i) {
+    check(near(before[i], after[i]), "diff() changed by the gradient", i);
+    check(near(gradient.gradient(i).eval(), after[i]),
+          "symbolic gradient differs from diff()", i);
+  }
+  return failures == 0 ? 0 : 1;
+}
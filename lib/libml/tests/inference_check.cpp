@@ -0,0 +1,92 @@
+// QuantizedMLP, HalfMLP and SparseMLP against InferenceModel::evaluate() at
+// each supported SIMD level, with and without an encoding. The outputs are
+// within about 1 of zero, the tolerances are absolute:
+//   int8           0.08
+//   fp16           0.01
+//   bfloat16       0.08
+//   sparse         1e-5 (same double sums, float outputs)
+
+#include "libml/compute/kernels.h"
+#include "libml/neural/dataset.h"
+#include "libml/neural/encodings.h"
+#include "libml/neural/half.h"
+#include "libml/neural/inference.h"
+#include "libml/neural/mlp.h"
+#include "libml/neural/quantized.h"
+#include "libml/neural/sparse.h"
+
+#include "check.h"
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+using namespace ml;
+
+namespace {
+template <class Model>
+void compare(const Model &model, const InferenceModel &reference,
+             const std::vector<float> &coords, const double tolerance,
+             const std::string &what) {
+  std::vector<float> rgb(coords.size() / 2 * 3), expected(rgb.size());
+  model.evaluate(coords, rgb);
+  reference.evaluate(coords, expected);
+  for (int i = 0; i < rgb.size(); ++i)
+    check(std::abs(rgb[i] - expected[i]) <= tolerance, what.c_str(), i);
+}
+
+void checkModels(const SimdLevel level, const Encoding *encoding) {
+  using Type = LayerBuilder::Type;
+  const std::string suffix =
+      std::string(" ") + simdLevelName(level) + (encoding ? " encoded" : "");
+  setSimdLevel(level);
+  ComputeGraph graph;
+  const int nbInputs = encoding ? encoding->nbOutputs() : 2;
+  MLP mlp(graph, {LayerBuilder(nbInputs, Type::Identity, false),
+                  LayerBuilder(32, Type::Sine, true),
+                  LayerBuilder(32, Type::ReLu, true),
+                  LayerBuilder(32, Type::Sigmoid, true),
+                  LayerBuilder(3, Type::Identity, false)});
+  for (int i = 0; i < mlp.nbWeights(); ++i)
+    mlp.setWeight(0.3 * std::sin(0.7 * i), i);
+  mlp.pruneToSparsity(0.5);
+  const InferenceModel reference = mlp.freeze(encoding);
+
+  // A grid over the unit square, also the calibration set
+  std::vector<double> inputs, outputs;
+  std::vector<float> coords;
+  for (int i = 0; i < 400; ++i) {
+    const double x = (i % 20) / 20.0, y = (i / 20) / 20.0;
+    inputs.insert(inputs.end(), {x, y});
+    outputs.insert(outputs.end(), {0.0, 0.0, 0.0});
+    coords.insert(coords.end(), {static_cast<float>(x), static_cast<float>(y)});
+  }
+  const DataSet dataSet({2, inputs}, {3, outputs});
+
+  compare(QuantizedMLP(reference, dataSet), reference, coords, 0.08,
+          "int8" + suffix);
+  compare(HalfMLP(reference, HalfFormat::FP16), reference, coords, 0.01,
+          "fp16" + suffix);
+  compare(HalfMLP(reference, HalfFormat::BF16), reference, coords, 0.08,
+          "bfloat16" + suffix);
+  compare(SparseMLP(reference), reference, coords, 1e-5, "sparse" + suffix);
+  if (!encoding)
+    compare(HalfMLP(mlp.topology(), HalfFormat::FP16,
+                    mlp.exportWeights(HalfFormat::FP16)),
+            reference, coords, 0.01, "exported fp16" + suffix);
+}
+} // namespace
+
+int main() {
+  const SimdLevel best = simdLevel();
+  const FourierEncoding encoding(4);
+  for (const SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE2,
+                                SimdLevel::AVX2, SimdLevel::AVX512}) {
+    if (!isSupported(level))
+      continue;
+    checkModels(level, nullptr);
+    checkModels(level, &encoding);
+  }
+  setSimdLevel(best);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,290 @@
+// Kernels of each supported SIMD level against the scalar ones, on sizes
+// around the register widths and the gemm blocks, and the 16-bit
+// conversions on their edge cases
+
+#include "libml/compute/kernels.h"
+
+#include "check.h"
+
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+using namespace ml;
+
+namespace {
+// 1 to 8 doubles and 16 floats or int32 per register, the tails of each,
+// and past the gemm blocks (KC = 128 and NC = 32)
+const std::vector<int> SIZES = {1,  2,  3,  4,  5,  7,  8,  9,
+                                15, 16, 17, 31, 33, 65, 129};
+
+std::vector<double> values(const int n, const double seed) {
+  std::vector<double> v(n);
+  for (int i = 0; i < n; ++i)
+    v[i] = std::sin(seed + 0.37 * i);
+  return v;
+}
+
+std::string name(const char *kernel, const SimdLevel level) {
+  return std::string(kernel) + " " + simdLevelName(level);
+}
+
+void checkGemv(const SimdLevel level) {
+  const std::string what = name("gemv", level);
+  const std::string whatT = name("gemvTransposed", level);
+  for (const int m : SIZES)
+    for (const int n : SIZES) {
+      const std::vector<double> a = values(m * n, 0.1), x = values(n, 0.2),
+                                b = values(m, 0.3), xt = values(m, 0.4);
+      const double *bias = (m + n) % 2 ? b.data() : nullptr;
+      std::vector<double> ref(m), y(m), refT(n), yT(n);
+      setSimdLevel(SimdLevel::Scalar);
+      gemv(m, n, a.data(), x.data(), bias, ref.data());
+      gemvTransposed(m, n, a.data(), xt.data(), refT.data());
+      setSimdLevel(level);
+      gemv(m, n, a.data(), x.data(), bias, y.data());
+      gemvTransposed(m, n, a.data(), xt.data(), yT.data());
+      for (int j = 0; j < m; ++j)
+        check(near(y[j], ref[j], 1e-12 * (n + 1)), what.c_str(), m * 1000 + n);
+      for (int j = 0; j < n; ++j)
+        check(near(yT[j], refT[j], 1e-12 * (m + 1)), whatT.c_str(),
+              m * 1000 + n);
+    }
+}
+
+void checkOuterProduct(const SimdLevel level) {
+  const std::string what = name("outerProduct", level);
+  for (const int m : SIZES)
+    for (const int n : SIZES) {
+      const std::vector<double> x = values(m, 0.5), y = values(n, 0.6);
+      std::vector<double> ref(m * n), a(m * n);
+      setSimdLevel(SimdLevel::Scalar);
+      outerProduct(m, n, x.data(), y.data(), ref.data());
+      setSimdLevel(level);
+      outerProduct(m, n, x.data(), y.data(), a.data());
+      check(a == ref, what.c_str(), m * 1000 + n);
+    }
+}
+
+void checkGemm(const SimdLevel level) {
+  const std::string what = name("gemm", level);
+  // n below and around NR = 2 * W, and past NC; k past KC
+  for (const int m : {1, 3, 4, 5, 9})
+    for (const int n : {1, 3, 4, 7, 8, 15, 16, 17, 33})
+      for (const int k : {1, 3, 9, 128, 129}) {
+        const std::vector<double> a = values(m * k, 0.7),
+                                  b = values(n * k, 0.8), bias = values(n, 0.9);
+        const double *bp = (m + n + k) % 2 ? bias.data() : nullptr;
+        std::vector<double> ref(m * n), c(m * n);
+        setSimdLevel(SimdLevel::Scalar);
+        gemm(m, n, k, a.data(), b.data(), bp, ref.data());
+        setSimdLevel(level);
+        gemm(m, n, k, a.data(), b.data(), bp, c.data());
+        for (int i = 0; i < m * n; ++i)
+          check(near(c[i], ref[i], 1e-12 * (k + 1)), what.c_str(),
+                (m * 100 + n) * 1000 + k);
+      }
+}
+
+void checkSinCos(const SimdLevel level) {
+  const std::string what = name("sinCos", level);
+  for (const int n : SIZES) {
+    std::vector<double> x = values(n, 1.0);
+    for (double &v : x)
+      v *= 300.0;
+    std::vector<double> s(n), c(n), sOnly(n), cOnly(n);
+    setSimdLevel(level);
+    sinCos(n, x.data(), s.data(), c.data());
+    sinCos(n, x.data(), sOnly.data(), nullptr);
+    sinCos(n, x.data(), nullptr, cOnly.data());
+    for (int i = 0; i < n; ++i) {
+      check(near(s[i], std::sin(x[i]), 1e-12), what.c_str(), n);
+      check(near(c[i], std::cos(x[i]), 1e-12), what.c_str(), n);
+      check(s[i] == sOnly[i] && c[i] == cOnly[i], what.c_str(), n);
+    }
+  }
+}
+
+void checkSparseGemv(const SimdLevel level) {
+  const std::string what = name("sparseGemv", level);
+  const int n = 17;
+  const std::vector<double> x = values(n, 1.1);
+  for (const int m : SIZES) {
+    // Rows of 0 to 6 nonzeros, padded like SparseMLP
+    std::vector<int> offsets = {0}, columns;
+    std::vector<double> entries;
+    for (int j = 0; j < m; j += SPARSE_SLICE) {
+      int length = 0;
+      for (int t = j; t < std::min(m, j + SPARSE_SLICE); ++t)
+        length = std::max(length, t * 5 % 7);
+      for (int p = 0; p < length; ++p)
+        for (int t = j; t < j + SPARSE_SLICE; ++t) {
+          const bool set = t < m && p < t * 5 % 7;
+          columns.push_back(set ? (t * 3 + p * 5) % n : 0);
+          entries.push_back(set ? std::cos(0.3 * t + p) : 0.0);
+        }
+      offsets.push_back(static_cast<int>(entries.size()));
+    }
+    const std::vector<double> bias = values(m, 1.2);
+    std::vector<double> ref(m), y(m);
+    setSimdLevel(SimdLevel::Scalar);
+    sparseGemv(m, offsets.data(), columns.data(), entries.data(), x.data(),
+               bias.data(), ref.data());
+    setSimdLevel(level);
+    sparseGemv(m, offsets.data(), columns.data(), entries.data(), x.data(),
+               bias.data(), y.data());
+    for (int j = 0; j < m; ++j)
+      check(near(y[j], ref[j], 1e-12 * (n + 1)), what.c_str(), m);
+  }
+}
+
+void checkGemvInt8(const SimdLevel level) {
+  const std::string what = name("gemvInt8", level);
+  for (const int m : SIZES)
+    for (const int n : SIZES) {
+      std::vector<int8_t> a(m * n);
+      for (int i = 0; i < a.size(); ++i)
+        a[i] = static_cast<int8_t>(i * 37 % 255 - 127);
+      std::vector<int16_t> x(n);
+      for (int i = 0; i < n; ++i)
+        x[i] = static_cast<int16_t>(i * 53 % 255 - 127);
+      std::vector<int8_t> packed(packedInt8Size(m, n));
+      packInt8(m, n, a.data(), packed.data());
+      std::vector<int32_t> ref(m), y(m);
+      setSimdLevel(SimdLevel::Scalar);
+      gemvInt8(m, n, packed.data(), x.data(), ref.data());
+      setSimdLevel(level);
+      gemvInt8(m, n, packed.data(), x.data(), y.data());
+      check(y == ref, what.c_str(), m * 1000 + n);
+    }
+}
+
+bool isNaN(const HalfFormat format, const uint16_t h) {
+  return std::isnan(fromHalf(format, h));
+}
+
+// The array conversions against the conversions of one value
+void checkHalf(const SimdLevel level, const HalfFormat format) {
+  const bool fp16 = format == HalfFormat::FP16;
+  const std::string what = name(fp16 ? "toHalf FP16" : "toHalf BF16", level);
+  const std::string whatFrom =
+      name(fp16 ? "fromHalf FP16" : "fromHalf BF16", level);
+  constexpr float inf = std::numeric_limits<float>::infinity();
+  // Subnormals of both formats, the rounding to the largest half or to
+  // infinity, the special values
+  std::vector<float> x = {0.0f,      -0.0f,     1.0f,      -1.0f,
+                          0x1p-24f,  0x1p-25f,  0x3p-26f,  0x1p-14f,
+                          0x1.ff8p-15f, 1e-7f,  -3e-6f,    65504.0f,
+                          65519.0f,  65520.0f,  -65520.0f, 1e6f,
+                          3.4e38f,   0x1p-126f, 0x1p-149f, -0x1p-140f,
+                          inf,       -inf,      std::nanf(""), 0.1f,
+                          1.0f / 3.0f, 1.00390625f, 1.0009765625f};
+  for (int i = 0; x.size() < 129; ++i)
+    x.push_back(std::sin(0.7f * i) * std::exp2(static_cast<float>(i % 40 - 20)));
+
+  setSimdLevel(level);
+  for (const int n : SIZES) {
+    std::vector<uint16_t> h(n);
+    toHalf(format, n, x.data(), h.data());
+    for (int i = 0; i < n; ++i) {
+      const uint16_t ref = toHalf(format, x[i]);
+      check(h[i] == ref || (isNaN(format, h[i]) && isNaN(format, ref)),
+            what.c_str(), i);
+    }
+  }
+  // Every half, then the tails
+  std::vector<uint16_t> all(65536);
+  for (int i = 0; i < all.size(); ++i)
+    all[i] = static_cast<uint16_t>(i);
+  std::vector<float> y(all.size());
+  fromHalf(format, static_cast<int>(all.size()), all.data(), y.data());
+  for (int i = 0; i < all.size(); ++i) {
+    const float ref = fromHalf(format, all[i]);
+    check(std::bit_cast<uint32_t>(y[i]) == std::bit_cast<uint32_t>(ref) ||
+              (std::isnan(y[i]) && std::isnan(ref)),
+          whatFrom.c_str(), i);
+  }
+  for (const int n : SIZES) {
+    std::vector<float> tail(n);
+    fromHalf(format, n, all.data() + 0x7bf0, tail.data());
+    for (int i = 0; i < n; ++i)
+      check(std::bit_cast<uint32_t>(tail[i]) ==
+                    std::bit_cast<uint32_t>(y[0x7bf0 + i]) ||
+                std::isnan(tail[i]),
+            whatFrom.c_str(), n);
+  }
+}
+
+// Values of the scalar conversions, which the other levels are held to
+void checkHalfValues() {
+  constexpr float inf = std::numeric_limits<float>::infinity();
+  const HalfFormat fp16 = HalfFormat::FP16, bf16 = HalfFormat::BF16;
+  check(toHalf(fp16, 65504.0f) == 0x7bff, "largest half", 0);
+  check(toHalf(fp16, 65519.0f) == 0x7bff, "rounded to the largest half", 0);
+  check(toHalf(fp16, 65520.0f) == 0x7c00, "rounded to infinity", 0);
+  check(toHalf(fp16, -inf) == 0xfc00, "negative infinity", 0);
+  check(isNaN(fp16, toHalf(fp16, std::nanf(""))), "NaN to half", 0);
+  check(toHalf(fp16, 0x1p-24f) == 0x0001, "smallest subnormal", 0);
+  check(toHalf(fp16, 0x1p-25f) == 0x0000, "subnormal tie to even", 0);
+  check(toHalf(fp16, 0x3p-26f) == 0x0001, "subnormal rounded up", 0);
+  check(fromHalf(fp16, 0x0001) == 0x1p-24f, "smallest subnormal", 1);
+  check(fromHalf(fp16, 0x03ff) == 0x3ffp-24f, "largest subnormal", 1);
+  check(fromHalf(fp16, 0x7c00) == inf, "infinity from half", 1);
+  check(std::isnan(fromHalf(fp16, 0x7e00)), "NaN from half", 1);
+  check(toHalf(bf16, 1.00390625f) == 0x3f80, "bfloat16 tie to even", 2);
+  check(toHalf(bf16, 3.4e38f) == 0x7f80, "bfloat16 rounded to infinity", 2);
+  check(isNaN(bf16, toHalf(bf16, std::nanf(""))), "NaN to bfloat16", 2);
+  check(fromHalf(bf16, 0x0001) == 0x1p-133f, "bfloat16 subnormal", 2);
+}
+
+void checkGemvHalf(const SimdLevel level, const HalfFormat format) {
+  const std::string what = name(format == HalfFormat::FP16
+                                    ? "gemvHalfTransposed FP16"
+                                    : "gemvHalfTransposed BF16",
+                                level);
+  for (const int m : {1, 3, 9, 17, 129, 257})
+    for (const int n : SIZES) {
+      std::vector<uint16_t> a(m * n), x(m);
+      for (int i = 0; i < a.size(); ++i)
+        a[i] = toHalf(format, std::sin(0.37f * i));
+      for (int i = 0; i < m; ++i)
+        x[i] = toHalf(format, std::cos(0.53f * i));
+      std::vector<float> bias(n);
+      for (int j = 0; j < n; ++j)
+        bias[j] = 0.1f * j;
+      const float *bp = (m + n) % 2 ? bias.data() : nullptr;
+      std::vector<float> ref(n), y(n);
+      setSimdLevel(SimdLevel::Scalar);
+      gemvHalfTransposed(format, m, n, a.data(), x.data(), bp, ref.data());
+      setSimdLevel(level);
+      gemvHalfTransposed(format, m, n, a.data(), x.data(), bp, y.data());
+      for (int j = 0; j < n; ++j)
+        check(near(y[j], ref[j], 1e-6 * (m + 1)), what.c_str(),
+              m * 1000 + n);
+    }
+}
+} // namespace
+
+int main() {
+  const SimdLevel best = simdLevel();
+  checkHalfValues();
+  for (const SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE2,
+                                SimdLevel::AVX2, SimdLevel::AVX512}) {
+    if (!isSupported(level))
+      continue;
+    checkGemv(level);
+    checkOuterProduct(level);
+    checkGemm(level);
+    checkSinCos(level);
+    checkSparseGemv(level);
+    checkGemvInt8(level);
+    for (const HalfFormat format : {HalfFormat::FP16, HalfFormat::BF16}) {
+      checkHalf(level, format);
+      checkGemvHalf(level, format);
+    }
+  }
+  setSimdLevel(best);
+  return failures == 0 ? 0 : 1;
+}
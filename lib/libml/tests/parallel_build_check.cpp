@@ -0,0 +1,73 @@
+// MLPs built by several worker threads against the same MLPs built on one
+// thread: node ids and labels, edges and slots, weights in the same order
+
+#include "libml/compute/graph.h"
+#include "libml/neural/mlp.h"
+
+#include "effolkronium/random.hpp"
+
+#include "check.h"
+
+#include <memory>
+#include <tuple>
+#include <vector>
+
+using namespace ml;
+using Random = effolkronium::random_static;
+
+namespace {
+struct Snapshot {
+  std::vector<std::tuple<uint32_t, std::string>> nodes;
+  std::vector<std::tuple<uint32_t, uint32_t, int>> edges;
+  std::vector<std::tuple<uint32_t, double>> weights;
+};
+
+Snapshot snapshot(ComputeGraph &graph, const MLP &mlp) {
+  Snapshot s;
+  for (int i = 0; i < graph.nbNodes(); ++i)
+    s.nodes.emplace_back(graph.nodeAt(i).id(), graph.nodeAt(i).label());
+  for (const ComputeEdge &e : graph.getEdges())
+    s.edges.emplace_back(e.src->id(), e.dst->id(), e.slot);
+  for (int i = 0; i < mlp.nbWeights(); ++i)
+    s.weights.emplace_back(mlp.getWeightNode(i).id(), mlp.getWeight(i));
+  return s;
+}
+
+// Wide enough layers for every grid to go past the parallel threshold,
+// then grown in place
+Snapshot build(const int nbThreads, const LayerBuilder::Type type) {
+  setBuildThreads(nbThreads);
+  Random::seed(7);
+  ComputeGraph graph;
+  MLP mlp(graph, {LayerBuilder(2, LayerBuilder::Type::Identity, false),
+                  LayerBuilder(48, type, true), LayerBuilder(40, type, true),
+                  LayerBuilder(3, LayerBuilder::Type::Identity, false)});
+  mlp.resizeLayer(1, 64);
+  mlp.insertLayer(2, LayerBuilder(36, type, true));
+  Snapshot s = snapshot(graph, mlp);
+  setBuildThreads(0);
+  return s;
+}
+
+void checkActivation(const LayerBuilder::Type type) {
+  const Snapshot serial = build(1, type);
+  const Snapshot parallel = build(4, type);
+  check(serial.nodes.size() == parallel.nodes.size(), "node count", 0);
+  check(serial.edges.size() == parallel.edges.size(), "edge count", 0);
+  check(serial.weights.size() == parallel.weights.size(), "weight count", 0);
+  for (int i = 0; i < serial.nodes.size() && i < parallel.nodes.size(); ++i)
+    check(serial.nodes[i] == parallel.nodes[i], "different node", i);
+  for (int i = 0; i < serial.edges.size() && i < parallel.edges.size(); ++i)
+    check(serial.edges[i] == parallel.edges[i], "different edge", i);
+  for (int i = 0; i < serial.weights.size() && i < parallel.weights.size();
+       ++i)
+    check(serial.weights[i] == parallel.weights[i], "different weight", i);
+}
+} // namespace
+
+int main() {
+  checkActivation(LayerBuilder::Type::ReLu);
+  checkActivation(LayerBuilder::Type::Sigmoid);
+  checkActivation(LayerBuilder::Type::Sine);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,57 @@
+// StaticMLP forward() and backward() against MLP::eval() and diff() after
+// loadWeights(), for each activation
+
+#include "libml/neural/losses.h"
+#include "libml/neural/mlp.h"
+#include "libml/neural/static_mlp.h"
+
+#include "check.h"
+
+#include <cmath>
+
+using namespace ml;
+
+namespace {
+template <LayerBuilder::Type Act> void checkActivation() {
+  using Net = StaticMLP<Act, 2, 8, 8, 3>;
+  ComputeGraph graph;
+  MLP mlp(graph, Net::layers());
+  check(mlp.nbWeights() == Net::NB_WEIGHTS, "different weight count", 0);
+  for (int i = 0; i < mlp.nbWeights(); ++i)
+    mlp.setWeight(0.5 * std::sin(0.7 * i), i);
+  MSELoss loss(mlp);
+  for (int i = 0; i < mlp.nbOutputs(); ++i)
+    loss.addInput(mlp.getOutputNode(i),
+                  graph.nodeFactory().createConstantNode(0.1 * i));
+  mlp.setInput(0.3, 0);
+  mlp.setInput(-0.6, 1);
+  mlp.eval();
+  loss.output().eval();
+  mlp.diff();
+
+  static Net net;
+  net.loadWeights(mlp);
+  const typename Net::Output &output = net.forward({0.3, -0.6});
+  typename Net::Output outputDiff;
+  for (int i = 0; i < Net::NB_OUTPUTS; ++i) {
+    check(near(output[i], mlp.getOutput(i)), "forward() differs from eval()",
+          i);
+    outputDiff[i] = mlp.getOutputNode(i).diff();
+  }
+  const typename Net::Input &inputDiff = net.backward(outputDiff);
+  for (int i = 0; i < Net::NB_WEIGHTS; ++i)
+    check(near(net.getWeightDiff(i), mlp.getWeightDiff(i)),
+          "weight gradient differs from diff()", i);
+  for (int i = 0; i < Net::NB_INPUTS; ++i)
+    check(near(inputDiff[i], mlp.getInputDiff(i)),
+          "input gradient differs from diff()", i);
+}
+} // namespace
+
+int main() {
+  checkActivation<LayerBuilder::Type::ReLu>();
+  checkActivation<LayerBuilder::Type::Sigmoid>();
+  checkActivation<LayerBuilder::Type::Sine>();
+  checkActivation<LayerBuilder::Type::Identity>();
+  return failures == 0 ? 0 : 1;
+}
@@ -1,9 +1,13 @@
 #include <array>
 #include <cmath>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <functional>
+#include <mutex>
 #include <optional>
+#include <thread>
 #include <stdio.h>
 #include <string.h>
 
@@ -17,12 +21,17 @@
 #include "tinyfiledialogs/tinyfiledialogs.h"
 
 #include "libml/compute/graph.h"
+#include "libml/compute/versioned.h"
 #include "libml/compute/visitors.h"
 #include "libml/neural/dataset.h"
+#include "libml/neural/encodings.h"
+#include "libml/neural/inference.h"
 #include "libml/neural/layers.h"
 #include "libml/neural/losses.h"
 #include "libml/neural/mlp.h"
 #include "libml/neural/optimizers.h"
+#include "libml/neural/quantized.h"
+#include "libml/neural/sparse.h"
 
 #include "Utils/GuiUtils.h"
 #include "Utils/MathUtils.h"
@@ -34,7 +43,17 @@
 #define L2_LOSS 1
 #define L1_LOSS 2
 
+#define NO_ENCODING 0
+#define HASH_GRID_ENCODING 1
+#define FOURIER_ENCODING 2
+
+#define FROZEN_EVAL 0
+#define QUANTIZED_EVAL 1
+#define SPARSE_EVAL 2
+
 #define MAX_PLOT_POINTS 200
+// optimize() steps between two looks at the commands
+#define STEPS_PER_CHUNK 64
 
 int ImGuiContentWidth() {
   const ImVec2 vMin = ImGui::GetWindowContentRegionMin();
@@ -89,34 +108,129 @@ private:
   RenderTexture2D _target;
 };
 
-struct ApplicationState {
-  std::optional<ml::DataSet> dataSet;
-  std::vector<int> deepLayerWidths;
-  std::vector<int> deepLayerActivationFuncs;
+struct OptimizerSettings {
+  int optimizer;
+  int loss;
+  double learningRate;
+  double momentum;
+  bool nesterov;
+};
+
+// What the UI shows of the training workspace
+struct TrainingStats {
+  // Incremented with each published model
+  int modelSerial = 0;
+  int trainingSteps = 0;
+  std::vector<double> avgMSE;
+  bool hasModel = false;
+  int nbPruned = 0;
+  int nbConnections = 0;
+  int graphNodes = 0;
+  int graphEdges = 0;
+  int mlpWeights = 0;
+  int mlpNodes = 0;
+  int mlpEdges = 0;
+  int optimizerNodes = 0;
+  int optimizerEdges = 0;
+  int lossNodes = 0;
+  int lossEdges = 0;
+};
+
+// Everything the training touches, only used on the training thread
+struct TrainingWorkspace {
   ml::ComputeGraph g;
+  std::unique_ptr<ml::Encoding> encoding;
   std::unique_ptr<ml::MLP> mlp;
   std::unique_ptr<ml::Optimizer> optimizer;
-  std::optional<Texture2D> inputImage;
+  // Copy of the training image, the optimizer points to it
+  std::optional<ml::DataSet> dataSet;
+  bool isInTraining = false;
   int trainingSteps = 0;
   std::vector<double> avgMSE;
+  // The mlp changed since the last published model
+  bool modelChanged = false;
+  int modelSerial = 0;
+};
+
+// Trains on its own thread, which owns the workspace: the UI posts commands
+// that run between two chunks of training steps, and reads the published
+// versions.
+class TrainingWorker {
+public:
+  using Command = std::function<void(TrainingWorkspace &)>;
+  // Frozen copy of the MLP read by the evaluators
+  ml::Versioned<ml::InferenceModel> model;
+  ml::Versioned<TrainingStats> stats;
+
+  TrainingWorker() : _thread([this] { _run(); }) {}
+  ~TrainingWorker() {
+    {
+      std::lock_guard lock(_mutex);
+      _stop = true;
+    }
+    _wake.notify_one();
+    _thread.join();
+  }
+  void post(Command command) {
+    {
+      std::lock_guard lock(_mutex);
+      _commands.push_back(std::move(command));
+    }
+    _wake.notify_one();
+  }
+
+private:
+  TrainingWorkspace _workspace;
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  std::vector<Command> _commands;
+  bool _stop = false;
+  // Last, the thread starts once the rest is constructed
+  std::thread _thread;
+
+  void _run();
+  void _publish();
+};
+
+struct ApplicationState {
+  std::optional<ml::DataSet> dataSet;
+  std::vector<int> deepLayerWidths;
+  std::vector<int> deepLayerActivationFuncs;
+  int currentEncoding = 0;
+  TrainingWorker worker;
+  // Serial of the model shown in the previews
+  int evaluatedSerial = 0;
+  std::optional<Texture2D> inputImage;
   bool isInTraining = false;
   bool isModelReady = false;
   bool autoEvalDuringTraining = false;
+  int currentEval = FROZEN_EVAL;
+  float pruneSparsity = 0.5f;
   int outputWidth = 2;
   int outputHeight = 2;
   Texture2D outputImage;
   std::optional<Texture2D> trainingOutputImage;
   const std::vector<const char *> activationFuncChoices = {"Identity", "ReLu",
-                                                           "Sigmoid"};
+                                                           "Sigmoid", "Sine"};
   int currentOptimizer = 1;
   const std::vector<const char *> optimizerChoices = {"Batch", "SGD_OP"};
   int currentLoss = 0;
   const std::vector<const char *> lossChoices = {"MSE", "L2", "L1"};
+  const std::vector<const char *> encodingChoices = {"None", "Hash grid",
+                                                     "Fourier features"};
+  const std::vector<const char *> evalChoices = {"Frozen model",
+                                                 "Quantized (int8)",
+                                                 "Sparse (pruned)"};
 
   double lastLearningRate = 0.01;
   double lastMomentum = 0.0;
   bool lastIsNesterov = false;
 
+  OptimizerSettings optimizerSettings() const {
+    return {currentOptimizer, currentLoss, lastLearningRate, lastMomentum,
+            lastIsNesterov};
+  }
+
   ApplicationState() {
     Image img = GenImageColor(outputWidth, outputHeight, BLACK);
     outputImage = LoadTextureFromImage(img);
@@ -249,15 +363,30 @@ ml::LayerBuilder::Type layerIndexToType(const int i) {
     return ml::LayerBuilder::Type::ReLu;
   case 2:
     return ml::LayerBuilder::Type::Sigmoid;
+  case 3:
+    return ml::LayerBuilder::Type::Sine;
+  }
+}
+
+std::unique_ptr<ml::Encoding> createEncoding(const int i) {
+  switch (i) {
+  default:
+  case NO_ENCODING:
+    return nullptr;
+  case HASH_GRID_ENCODING:
+    return std::make_unique<ml::HashGridEncoding>();
+  case FOURIER_ENCODING:
+    return std::make_unique<ml::FourierEncoding>();
   }
 }
 
 std::unique_ptr<ml::MLP>
-buildCBNR(ml::ComputeGraph &g, const std::vector<int> &deepLayerWidths,
+buildCBNR(ml::ComputeGraph &g, const int nbInputs,
+          const std::vector<int> &deepLayerWidths,
           const std::vector<int> &deepLayerActivationFuncs) {
   std::vector<ml::LayerBuilder> layers;
   layers.push_back(
-      ml::LayerBuilder(2, ml::LayerBuilder::Type::Identity, false));
+      ml::LayerBuilder(nbInputs, ml::LayerBuilder::Type::Identity, false));
   for (int i = 0; i < deepLayerWidths.size(); ++i) {
     layers.push_back(
         ml::LayerBuilder(deepLayerWidths[i],
@@ -268,46 +397,152 @@ buildCBNR(ml::ComputeGraph &g, const std::vector<int> &deepLayerWidths,
   return std::make_unique<ml::MLP>(g, layers);
 }
 
-void evalMlPToTexture(ml::MLP &mlp, Texture2D &t) {
+std::unique_ptr<ml::InferenceModel>
+freezeModel(const ml::MLP &mlp, const ml::Encoding *encoding) {
+  return std::make_unique<ml::InferenceModel>(mlp.freeze(encoding));
+}
+
+// Any inference model (InferenceModel, QuantizedMLP, SparseMLP), a row at a
+// time
+template <class Model> void evalModelToTexture(const Model &m, Texture2D &t) {
+  std::vector<float> coords(t.width * 2);
+  std::vector<float> outputs(t.width * m.nbOutputs());
   std::vector<Color> colors;
   colors.reserve(t.width * t.height);
   for (int y = 0; y < t.height; ++y) {
+    // In normalized space, a row at a time
     for (int x = 0; x < t.width; ++x) {
-      // In normalized space
-      mlp.setInput(static_cast<double>(x) / static_cast<double>(t.width), 0);
-      mlp.setInput(static_cast<double>(y) / static_cast<double>(t.height), 1);
-      mlp.eval();
-      // Fetch the colors to RGBA 32bit
-      constexpr double channelMaxVal = 255.0;
-      Color c = {static_cast<unsigned char>(std::clamp(
-                     mlp.getOutput(0) * channelMaxVal, 0.0, channelMaxVal)),
-                 static_cast<unsigned char>(std::clamp(
-                     mlp.getOutput(1) * channelMaxVal, 0.0, channelMaxVal)),
-                 static_cast<unsigned char>(std::clamp(
-                     mlp.getOutput(2) * channelMaxVal, 0.0, channelMaxVal)),
-                 static_cast<unsigned char>(channelMaxVal)};
-      colors.push_back(c);
+      coords[x * 2] = static_cast<float>(x) / static_cast<float>(t.width);
+      coords[x * 2 + 1] = static_cast<float>(y) / static_cast<float>(t.height);
+    }
+    m.evaluate(coords, outputs);
+    // Fetch the colors to RGBA 32bit
+    constexpr float channelMaxVal = 255.0f;
+    for (int x = 0; x < t.width; ++x) {
+      auto channel = [&](const int i) {
+        return static_cast<unsigned char>(
+            std::clamp(outputs[x * m.nbOutputs() + i] * channelMaxVal, 0.0f,
+                       channelMaxVal));
+      };
+      colors.push_back({channel(0), channel(1), channel(2),
+                        static_cast<unsigned char>(channelMaxVal)});
     }
   }
   UpdateTexture(t, &colors[0]);
 }
 
-void createOptimizer(ApplicationState &s) {
+void createOptimizer(TrainingWorkspace &ws, const OptimizerSettings &s) {
+  ws.optimizer.reset();
   std::unique_ptr<ml::Loss> loss;
-  if (s.currentLoss == MSE_LOSS)
-    loss = std::make_unique<ml::MSELoss>(s.g);
-  else if (s.currentLoss == L2_LOSS)
-    loss = std::make_unique<ml::L2Loss>(s.g);
+  if (s.loss == MSE_LOSS)
+    loss = std::make_unique<ml::MSELoss>(ws.g);
+  else if (s.loss == L2_LOSS)
+    loss = std::make_unique<ml::L2Loss>(ws.g);
   else
-    loss = std::make_unique<ml::L1Loss>(s.g);
-  if (s.currentOptimizer == BATCH_OP) {
-    s.optimizer = std::make_unique<ml::BatchOptimizer>(
-        *s.mlp, std::move(loss), s.lastLearningRate, s.lastMomentum);
-  } else if (s.currentOptimizer == SGD_OP) {
-    s.optimizer = std::make_unique<ml::SGDOptimizer>(
-        *s.mlp, std::move(loss), s.lastLearningRate, s.lastMomentum,
-        s.lastIsNesterov);
+    loss = std::make_unique<ml::L1Loss>(ws.g);
+  if (s.optimizer == BATCH_OP) {
+    ws.optimizer = std::make_unique<ml::BatchOptimizer>(
+        *ws.mlp, std::move(loss), s.learningRate, s.momentum);
+  } else if (s.optimizer == SGD_OP) {
+    ws.optimizer = std::make_unique<ml::SGDOptimizer>(
+        *ws.mlp, std::move(loss), s.learningRate, s.momentum, s.nesterov);
   }
+  ws.optimizer->setEncoding(ws.encoding.get());
+  if (ws.dataSet.has_value())
+    ws.optimizer->setDataset(ws.dataSet.value());
+}
+
+// Learning rate, momentum and nesterov of the current optimizer
+void updateOptimizer(TrainingWorkspace &ws, const OptimizerSettings &s) {
+  if (auto *batch = dynamic_cast<ml::BatchOptimizer *>(ws.optimizer.get())) {
+    batch->learningRate = s.learningRate;
+    batch->momentum = s.momentum;
+  } else if (auto *sgd =
+                 dynamic_cast<ml::SGDOptimizer *>(ws.optimizer.get())) {
+    sgd->learningRate = s.learningRate;
+    sgd->momentum = s.momentum;
+    sgd->nesterov = s.nesterov;
+  }
+}
+
+// In place edit of the MLP, the optimizer keeps the state of the weights
+// that remain
+void postModelEdit(TrainingWorker &worker,
+                   std::function<std::vector<int>(ml::MLP &)> edit) {
+  worker.post([edit = std::move(edit)](TrainingWorkspace &ws) {
+    if (!ws.mlp)
+      return;
+    ws.optimizer->remapWeights(edit(*ws.mlp));
+    ws.modelChanged = true;
+  });
+}
+
+void TrainingWorker::_run() {
+  TrainingWorkspace &ws = _workspace;
+  std::vector<Command> commands;
+  for (;;) {
+    {
+      std::unique_lock lock(_mutex);
+      // Only sleeps when there is no training to run
+      _wake.wait(lock, [&] {
+        return _stop || !_commands.empty() || ws.isInTraining;
+      });
+      if (_stop)
+        return;
+      std::swap(commands, _commands);
+    }
+    for (Command &command : commands)
+      command(ws);
+    const bool changed = !commands.empty();
+    commands.clear();
+
+    if (ws.isInTraining) {
+      // run a chunk of the training pass, a pass may span several chunks
+      for (int step = 0; step < STEPS_PER_CHUNK; ++step) {
+        if (ws.optimizer->optimize())
+          continue;
+        ++ws.trainingSteps;
+        ws.avgMSE.push_back(ws.optimizer->getLoss().loss);
+        if (ws.avgMSE.size() > MAX_PLOT_POINTS)
+          ws.avgMSE.erase(ws.avgMSE.begin());
+        break;
+      }
+      ws.modelChanged = true;
+    }
+    if (changed || ws.isInTraining)
+      _publish();
+  }
+}
+
+void TrainingWorker::_publish() {
+  TrainingWorkspace &ws = _workspace;
+  if (ws.modelChanged && ws.mlp) {
+    model.publish(freezeModel(*ws.mlp, ws.encoding.get()));
+    ++ws.modelSerial;
+  }
+  ws.modelChanged = false;
+
+  auto s = std::make_unique<TrainingStats>();
+  s->modelSerial = ws.modelSerial;
+  s->trainingSteps = ws.trainingSteps;
+  s->avgMSE = ws.avgMSE;
+  s->graphNodes = ws.g.nbNodes();
+  s->graphEdges = static_cast<int>(ws.g.getEdges().size());
+  if (ws.mlp) {
+    s->hasModel = true;
+    s->nbPruned = ws.mlp->nbPruned();
+    s->nbConnections = ws.mlp->nbConnections();
+    s->mlpWeights = ws.mlp->nbWeights();
+    s->mlpNodes = ws.mlp->nbNodes();
+    s->mlpEdges = static_cast<int>(ws.mlp->getEdges().size());
+  }
+  if (ws.optimizer) {
+    s->optimizerNodes = ws.optimizer->nbNodes();
+    s->optimizerEdges = static_cast<int>(ws.optimizer->getEdges().size());
+    s->lossNodes = ws.optimizer->getLoss().nbNodes();
+    s->lossEdges = static_cast<int>(ws.optimizer->getLoss().getEdges().size());
+  }
+  stats.publish(std::move(s));
 }
 
 void askLoadInputImage(ApplicationState &s) {
@@ -338,33 +573,38 @@ int main(int argc, char *argv[]) {
     BeginDrawing();
     ClearBackground({30, 31, 34, 255});
 
-    if (appState.isInTraining) {
-      // run a training pass
-      while (appState.optimizer->optimize())
-        ;
-      ++appState.trainingSteps;
-      // TODO : improve API for this
-      double loss = appState.optimizer->getLoss().loss;
-
-      appState.avgMSE.push_back(loss);
-      if (appState.avgMSE.size() > MAX_PLOT_POINTS)
-        appState.avgMSE.erase(appState.avgMSE.begin());
+    // Copied, the UI doesn't pin a version for the whole frame
+    TrainingStats stats;
+    if (const auto snapshot = appState.worker.stats.read())
+      stats = *snapshot;
 
+    // Each new version of the model is evaluated once, in place
+    if (stats.modelSerial != appState.evaluatedSerial) {
+      appState.evaluatedSerial = stats.modelSerial;
+      const auto snapshot = appState.worker.model.read();
       // Update the result on the output preview
-      evalMlPToTexture(*appState.mlp, appState.trainingOutputImage.value());
+      if (snapshot && appState.trainingOutputImage.has_value())
+        evalModelToTexture(*snapshot, appState.trainingOutputImage.value());
 
       // Update the result to the resolution independant image
       // (upscaling/donwscaling)
       // If both image are the same, just copy the pixels over
-      if (appState.outputImage.width == appState.trainingOutputImage->width &&
-          appState.outputImage.height && appState.autoEvalDuringTraining) {
-        Image img = LoadImageFromTexture(appState.trainingOutputImage.value());
-        Color *colors = LoadImageColors(img);
-        UpdateTexture(appState.outputImage, colors);
-        UnloadImageColors(colors);
-        UnloadImage(img);
-      } else if (appState.autoEvalDuringTraining)
-        evalMlPToTexture(*appState.mlp, appState.outputImage);
+      if (snapshot && appState.isInTraining &&
+          appState.autoEvalDuringTraining) {
+        if (appState.trainingOutputImage.has_value() &&
+            appState.outputImage.width ==
+                appState.trainingOutputImage->width &&
+            appState.outputImage.height ==
+                appState.trainingOutputImage->height) {
+          Image img =
+              LoadImageFromTexture(appState.trainingOutputImage.value());
+          Color *colors = LoadImageColors(img);
+          UpdateTexture(appState.outputImage, colors);
+          UnloadImageColors(colors);
+          UnloadImage(img);
+        } else
+          evalModelToTexture(*snapshot, appState.outputImage);
+      }
     }
 
     // Gui drawing
@@ -379,18 +619,37 @@ int main(int argc, char *argv[]) {
       if (ImGui::MenuItem("Save")) {
       }
       if (ImGui::MenuItem("Export to graphviz dot")) {
-        auto outputs = appState.g.getOutputNodes();
-        if (outputs.empty()) {
+        if (stats.graphNodes == 0) {
           tinyfd_messageBox("Empty graph", "Compute graph is empty", "ok",
                             "error", 1);
         } else {
           std::optional<std::string> path = saveFileExt({"*.dot"});
+          // The graph belongs to the training thread
+          if (path.has_value())
+            appState.worker.post([path = path.value()](TrainingWorkspace &ws) {
+              ml::GraphvizVisitor v;
+              for (ml::ComputeNode &n : ws.g.getOutputNodes()) {
+                n.backwardVisit(v);
+              }
+              v.saveToFile(path);
+            });
+        }
+      }
+      if (ImGui::MenuItem("Export model to C++ header")) {
+        if (!stats.hasModel) {
+          tinyfd_messageBox("No model", "No model to export", "ok", "error",
+                            1);
+        } else {
+          std::optional<std::string> path = saveFileExt({"*.h", "*.hpp"});
           if (path.has_value()) {
-            ml::GraphvizVisitor v;
-            for (ml::ComputeNode &n : outputs) {
-              n.backwardVisit(v);
-            }
-            v.saveToFile(path.value());
+            // Pinned only while writing, not during the dialogs
+            bool saved = false;
+            if (const auto snapshot = appState.worker.model.read())
+              saved = snapshot->saveSource(path.value());
+            if (!saved)
+              tinyfd_messageBox("Export failed",
+                                "Could not write the model header", "ok",
+                                "error", 1);
           }
         }
       }
@@ -524,14 +783,30 @@ int main(int argc, char *argv[]) {
 
       ImGui::Separator();
 
-      if (!appState.mlp)
+      if (!stats.hasModel)
         ImGui::BeginDisabled();
       if (ImGui::Button("Eval model", ImVec2(ImGuiContentWidth(), 0))) {
-        evalMlPToTexture(*appState.mlp.get(), appState.outputImage);
+        // The int8 model is calibrated on the training image, the frozen
+        // model is used without one
+        if (const auto snapshot = appState.worker.model.read()) {
+          if (appState.currentEval == QUANTIZED_EVAL &&
+              appState.dataSet.has_value())
+            evalModelToTexture(
+                ml::QuantizedMLP(*snapshot, appState.dataSet.value()),
+                appState.outputImage);
+          else if (appState.currentEval == SPARSE_EVAL)
+            evalModelToTexture(ml::SparseMLP(*snapshot), appState.outputImage);
+          else
+            evalModelToTexture(*snapshot, appState.outputImage);
+        }
       }
-      if (!appState.mlp)
+      if (!stats.hasModel)
         ImGui::EndDisabled();
 
+      ImGui::Combo("Eval with", &appState.currentEval,
+                   appState.evalChoices.data(),
+                   static_cast<int>(appState.evalChoices.size()));
+
       ImGui::Checkbox("Auto eval during training",
                       &appState.autoEvalDuringTraining);
 
@@ -541,9 +816,6 @@ int main(int argc, char *argv[]) {
 
     if (ImGui::Begin("Model builder")) {
 
-      if (appState.isInTraining)
-        ImGui::BeginDisabled();
-
       if (ImGui::Button("Load", ImVec2(ImGuiContentWidth(), 0))) {
       }
       if (ImGui::Button("Save", ImVec2(ImGuiContentWidth(), 0))) {
@@ -551,22 +823,41 @@ int main(int argc, char *argv[]) {
       ImGui::Separator();
 
       if (ImGui::Button("Build MLP", ImVec2(ImGuiContentWidth(), 0))) {
-        appState.trainingSteps = 0;
-        appState.avgMSE = {};
-        // We always have to reconstruct the optimizer
-        appState.optimizer.reset();
-        appState.mlp.reset();
-        appState.mlp = buildCBNR(appState.g, appState.deepLayerWidths,
-                                 appState.deepLayerActivationFuncs);
-        // Always create en optimizer by using the last specified settings
-        createOptimizer(appState);
+        appState.worker.post(
+            [encoding = appState.currentEncoding,
+             widths = appState.deepLayerWidths,
+             activations = appState.deepLayerActivationFuncs,
+             settings = appState.optimizerSettings()](TrainingWorkspace &ws) {
+              ws.trainingSteps = 0;
+              ws.avgMSE = {};
+              // We always have to reconstruct the optimizer
+              ws.optimizer.reset();
+              ws.mlp.reset();
+              ws.encoding = createEncoding(encoding);
+              ws.mlp = buildCBNR(ws.g,
+                                 ws.encoding ? ws.encoding->nbOutputs() : 2,
+                                 widths, activations);
+              ws.modelChanged = true;
+              // Always create en optimizer by using the last specified
+              // settings
+              createOptimizer(ws, settings);
+            });
       }
+      ImGui::Combo("Input encoding", &appState.currentEncoding,
+                   appState.encodingChoices.data(),
+                   static_cast<int>(appState.encodingChoices.size()));
       ImGui::Text(
           fmt::format("Deep layer number: {}", appState.deepLayerWidths.size())
               .c_str());
+      // A built MLP is edited in place and keeps its trained weights
       if (ImGui::Button("Add new deep Layer")) {
         appState.deepLayerWidths.push_back(1);
         appState.deepLayerActivationFuncs.push_back(0);
+        const int index = static_cast<int>(appState.deepLayerWidths.size());
+        postModelEdit(appState.worker, [index](ml::MLP &mlp) {
+          return mlp.insertLayer(index,
+                                 ml::LayerBuilder(1, layerIndexToType(0), true));
+        });
       }
       std::vector<bool> toRemove(appState.deepLayerWidths.size());
       bool update = false;
@@ -576,11 +867,22 @@ int main(int argc, char *argv[]) {
                               &appState.deepLayerWidths[i])) {
             if (appState.deepLayerWidths[i] < 1)
               appState.deepLayerWidths[i] = 1;
+            const int size = appState.deepLayerWidths[i];
+            postModelEdit(appState.worker, [i, size](ml::MLP &mlp) {
+              return mlp.resizeLayer(i + 1, size);
+            });
+          }
+          if (ImGui::Combo(
+                  fmt::format("Activation function ##Layer {}", i).c_str(),
+                  &appState.deepLayerActivationFuncs[i],
+                  appState.activationFuncChoices.data(),
+                  static_cast<int>(appState.activationFuncChoices.size()))) {
+            const auto type =
+                layerIndexToType(appState.deepLayerActivationFuncs[i]);
+            postModelEdit(appState.worker, [i, type](ml::MLP &mlp) {
+              return mlp.setActivation(i + 1, type);
+            });
           }
-          ImGui::Combo(fmt::format("Activation function ##Layer {}", i).c_str(),
-                       &appState.deepLayerActivationFuncs[i],
-                       appState.activationFuncChoices.data(),
-                       static_cast<int>(appState.activationFuncChoices.size()));
           if (ImGui::Button(fmt::format("Remove ##Layer {}", i).c_str())) {
             update = true;
             toRemove[i] = true;
@@ -594,68 +896,74 @@ int main(int argc, char *argv[]) {
                                            i);
             appState.deepLayerActivationFuncs.erase(
                 appState.deepLayerActivationFuncs.begin() + i);
+            postModelEdit(appState.worker, [i](ml::MLP &mlp) {
+              return mlp.removeLayer(i + 1);
+            });
           }
         }
       }
-      if (appState.isInTraining)
-        ImGui::EndDisabled();
     }
     ImGui::End();
 
     if (ImGui::Begin("Training settings")) {
 
-      if (appState.mlp) {
-
-        if (appState.isInTraining)
-          ImGui::BeginDisabled();
-
-        if (ImGui::Combo("Optimizer", &appState.currentOptimizer,
-                         appState.optimizerChoices.data(),
-                         static_cast<int>(appState.optimizerChoices.size()))) {
-          appState.optimizer.reset();
-          createOptimizer(appState);
-        }
-        if (ImGui::Combo("Loss", &appState.currentLoss,
-                         appState.lossChoices.data(),
-                         static_cast<int>(appState.lossChoices.size()))) {
-          appState.optimizer.reset();
-          createOptimizer(appState);
-        }
+      if (stats.hasModel) {
+
+        bool reset = false;
+        reset |= ImGui::Combo(
+            "Optimizer", &appState.currentOptimizer,
+            appState.optimizerChoices.data(),
+            static_cast<int>(appState.optimizerChoices.size()));
+        reset |= ImGui::Combo("Loss", &appState.currentLoss,
+                              appState.lossChoices.data(),
+                              static_cast<int>(appState.lossChoices.size()));
+
+        bool update = false;
+        update |= ImGui::InputDouble("Learning rate", &appState.lastLearningRate);
+        update |= ImGui::InputDouble("Momentum", &appState.lastMomentum);
+        if (appState.currentOptimizer == SGD_OP)
+          update |= ImGui::Checkbox("Nesterov", &appState.lastIsNesterov);
+
+        reset |= ImGui::Button("Reset", ImVec2(ImGuiContentWidth(), 0));
+        if (reset)
+          appState.worker.post([settings = appState.optimizerSettings()](
+                                   TrainingWorkspace &ws) {
+            if (ws.mlp)
+              createOptimizer(ws, settings);
+          });
+        else if (update)
+          appState.worker.post([settings = appState.optimizerSettings()](
+                                   TrainingWorkspace &ws) {
+            updateOptimizer(ws, settings);
+          });
 
-        if (appState.currentOptimizer == BATCH_OP) {
-          if (ImGui::InputDouble("Learning rate", &appState.lastLearningRate)) {
-            static_cast<ml::BatchOptimizer *>(appState.optimizer.get())
-                ->learningRate = appState.lastLearningRate;
-          }
-          if (ImGui::InputDouble("Momentum", &appState.lastMomentum)) {
-            static_cast<ml::BatchOptimizer *>(appState.optimizer.get())
-                ->momentum = appState.lastMomentum;
-          }
-        } else if (appState.currentOptimizer == SGD_OP) {
-          if (ImGui::InputDouble("Learning rate", &appState.lastLearningRate)) {
-            static_cast<ml::SGDOptimizer *>(appState.optimizer.get())
-                ->learningRate = appState.lastLearningRate;
-          }
-          if (ImGui::InputDouble("Momentum", &appState.lastMomentum)) {
-            static_cast<ml::SGDOptimizer *>(appState.optimizer.get())
-                ->momentum = appState.lastMomentum;
-          }
-          if (ImGui::Checkbox("Nesterov", &appState.lastIsNesterov)) {
-            static_cast<ml::SGDOptimizer *>(appState.optimizer.get())
-                ->nesterov = appState.lastIsNesterov;
-          }
-        }
-
-        if (ImGui::Button("Reset", ImVec2(ImGuiContentWidth(), 0))) {
-          appState.optimizer.reset();
-          createOptimizer(appState);
-        }
+        ImGui::Separator();
+        // The pruned weights stay at 0, training again fine-tunes the others
+        ImGui::SliderFloat("Target sparsity", &appState.pruneSparsity, 0.0f,
+                           0.99f);
+        if (ImGui::Button("Prune weights", ImVec2(ImGuiContentWidth(), 0)))
+          appState.worker.post([sparsity = appState.pruneSparsity](
+                                   TrainingWorkspace &ws) {
+            if (!ws.mlp)
+              return;
+            ws.mlp->pruneToSparsity(sparsity);
+            ws.modelChanged = true;
+          });
+        if (ImGui::Button("Clear pruning", ImVec2(ImGuiContentWidth(), 0)))
+          appState.worker.post([](TrainingWorkspace &ws) {
+            if (ws.mlp)
+              ws.mlp->clearPruning();
+          });
+        ImGui::Text("%s", fmt::format("Pruned: {} of {} connections",
+                                      stats.nbPruned, stats.nbConnections)
+                              .c_str());
+        ImGui::Separator();
 
         if (appState.isInTraining) {
-          ImGui::EndDisabled();
           if (ImGui::Button("Stop training", ImVec2(ImGuiContentWidth(), 0))) {
             appState.isInTraining = false;
-            window.setTargetFps(60);
+            appState.worker.post(
+                [](TrainingWorkspace &ws) { ws.isInTraining = false; });
           }
         } else if (ImGui::Button("Start training",
                                  ImVec2(ImGuiContentWidth(), 0))) {
@@ -663,10 +971,16 @@ int main(int argc, char *argv[]) {
             askLoadInputImage(appState);
           }
           if (appState.inputImage.has_value()) {
-            // Set the dataset and rung the training
-            appState.optimizer->setDataset(appState.dataSet.value());
             appState.isInTraining = true;
-            window.setTargetFps(0);
+            // Set the dataset and rung the training
+            appState.worker.post([dataSet = appState.dataSet.value()](
+                                     TrainingWorkspace &ws) mutable {
+              if (!ws.optimizer)
+                return;
+              ws.dataSet.emplace(std::move(dataSet));
+              ws.optimizer->setDataset(ws.dataSet.value());
+              ws.isInTraining = true;
+            });
           }
         }
 
@@ -677,20 +991,19 @@ int main(int argc, char *argv[]) {
     ImGui::End();
 
     if (ImGui::Begin("Model performance")) {
-      if (!appState.avgMSE.empty()) {
-        ImGui::Text(fmt::format("Latest MSE: {:.6}",
-                                appState.avgMSE[appState.avgMSE.size() - 1])
+      if (!stats.avgMSE.empty()) {
+        ImGui::Text(fmt::format("Latest MSE: {:.6}", stats.avgMSE.back())
                         .c_str());
         ImGui::Separator();
-        ImGui::Text(fmt::format("Total training steps: {}",
-                                static_cast<int>(appState.trainingSteps))
-                        .c_str());
+        ImGui::Text(
+            fmt::format("Total training steps: {}", stats.trainingSteps)
+                .c_str());
         ImGui::Separator();
         if (appState.isInTraining)
           ImPlot::SetNextAxesToFit();
         ImPlot::BeginPlot("Image MSE");
-        ImPlot::PlotLine("MSE##data", appState.avgMSE.data(),
-                         static_cast<int>(appState.avgMSE.size()));
+        ImPlot::PlotLine("MSE##data", stats.avgMSE.data(),
+                         static_cast<int>(stats.avgMSE.size()));
         ImPlot::EndPlot();
       } else
         ImGui::TextColored({1, 0, 0, 1}, "WAITING FOR TRAINING DATA");
@@ -700,34 +1013,26 @@ int main(int argc, char *argv[]) {
     if (ImGui::Begin("Debug")) {
       ImGui::LabelText("Frame Time", "%.2f ms", GetFrameTime() * 1000.0f);
       ImGui::Separator();
-      ImGui::LabelText("Total compute nodes", "%d nodes", appState.g.nbNodes());
+      ImGui::LabelText("Total compute nodes", "%d nodes", stats.graphNodes);
       ImGui::Separator();
-      ImGui::LabelText("Total compute edges", "%d edges",
-                       appState.g.getEdges().size());
+      ImGui::LabelText("Total compute edges", "%d edges", stats.graphEdges);
       ImGui::Separator();
-      if (appState.mlp) {
-        ImGui::LabelText("MLP weights", "%d weights",
-                         appState.mlp->nbWeights());
+      if (stats.hasModel) {
+        ImGui::LabelText("MLP weights", "%d weights", stats.mlpWeights);
         ImGui::Separator();
-        ImGui::LabelText("MLP compute nodes", "%d nodes",
-                         appState.mlp->nbNodes());
+        ImGui::LabelText("MLP compute nodes", "%d nodes", stats.mlpNodes);
         ImGui::Separator();
-        ImGui::LabelText("MLP compute edges", "%d edges",
-                         appState.mlp->getEdges().size());
+        ImGui::LabelText("MLP compute edges", "%d edges", stats.mlpEdges);
         ImGui::Separator();
-      }
-      if (appState.optimizer) {
         ImGui::LabelText("Optimizer compute nodes", "%d nodes",
-                         appState.optimizer->nbNodes());
+                         stats.optimizerNodes);
         ImGui::Separator();
         ImGui::LabelText("Optimizer compute edges", "%d edges",
-                         appState.optimizer->getEdges().size());
+                         stats.optimizerEdges);
         ImGui::Separator();
-        ImGui::LabelText("Loss compute nodes", "%d nodes",
-                         appState.optimizer->getLoss().nbNodes());
+        ImGui::LabelText("Loss compute nodes", "%d nodes", stats.lossNodes);
         ImGui::Separator();
-        ImGui::LabelText("Loss compute edges", "%d edges",
-                         appState.optimizer->getLoss().getEdges().size());
+        ImGui::LabelText("Loss compute edges", "%d edges", stats.lossEdges);
         ImGui::Separator();
       }
     }